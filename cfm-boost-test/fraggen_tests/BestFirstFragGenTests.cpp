@@ -0,0 +1,50 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# BestFirstFragGenTests.cpp
+#
+# Description: Tests that best-first fragment graph generation keeps the
+#              most probable fragments found within its budgets
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+
+std::vector<std::string> best_first_fraggen_test_molecules{"NC(CCC(=O)O)C(=O)O", "Oc1ccccc1C(=O)OCC",
+                                                           "CN1C=NC2=C1C(=O)N(C(=O)N2C)C"};
+
+BOOST_AUTO_TEST_SUITE(BestFirstFragGenTests)
+
+BOOST_DATA_TEST_CASE(FragmentBudgetKeepsMostProbable, bdata::make(best_first_fraggen_test_molecules),
+                     smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param             = getTestParam(cfg);
+	cfg.use_best_first_fg_gen = true;
+
+	// Fragments are added in order of probability, so a budget keeps a prefix of the full graph
+	FragmentGraph *full_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+	BOOST_REQUIRE_GT(full_graph->getNumFragments(), 3);
+
+	for (unsigned int max_fragments : {1, 2, 3}) {
+		cfg.best_first_max_fragments = max_fragments;
+		FragmentGraph *graph         = nullptr;
+		BOOST_REQUIRE_NO_THROW(graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param));
+		BOOST_REQUIRE_EQUAL(graph->getNumFragments(), max_fragments);
+		for (int i = 0; i < graph->getNumFragments(); i++) {
+			BOOST_CHECK_EQUAL(*graph->getFragmentAtIdx(i)->getIonSmiles(),
+			                  *full_graph->getFragmentAtIdx(i)->getIonSmiles());
+			BOOST_CHECK_CLOSE(graph->getFragmentAtIdx(i)->getMass(), full_graph->getFragmentAtIdx(i)->getMass(),
+			                  1e-6);
+		}
+		delete graph;
+	}
+
+	delete full_graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
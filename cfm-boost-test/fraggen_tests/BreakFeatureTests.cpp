@@ -0,0 +1,73 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# BreakFeatureTests.cpp
+#
+# Description: Tests that the features computed from a parent and a break
+#              match those computed from the children of the break
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FeatureCalculator.h"
+#include "FragGenTestsUtils.h"
+
+std::vector<std::string> break_feature_test_molecules{"CC(=O)O", "NC(CCC(=O)O)C(=O)O", "Oc1ccccc1C(=O)OCC",
+                                                      "CN1C=NC2=C1C(=O)N(C(=O)N2C)C", "CCOP(=O)(OCC)SCCN"};
+
+// Check the features computed from each (non-ring) break of the node against those of the children
+// it gives, then do the same for the breaks of those children, down to the given depth
+static void checkBreakFeatures(FragmentTreeNode &node, FeatureCalculator &fc, int depth) {
+	std::vector<Break> breaks;
+	node.generateBreaks(breaks, false, false);
+	for (auto &brk : breaks) {
+		if (brk.isRingBreak() || brk.isIonicBreak() || brk.isHydrogenOnlyBreak()) continue;
+		node.applyBreak(brk, 0);
+		size_t num_prev_children = node.children.size();
+		node.generateChildrenOfBreak(brk);
+
+		RDKit::Bond *bond = node.ion->getBondWithIdx(brk.getBondIdx());
+		for (size_t i = num_prev_children; i < node.children.size(); i++) {
+			FragmentTreeNode &child = node.children[i];
+			Transition t(-1, -1, child.nl, child.ion);
+			unsigned int ion_root_idx;
+			t.getIon()->root->getProp("OrigIdx", ion_root_idx);
+
+			pending_child_t pending;
+			pending.parent          = node.ion;
+			pending.broken_bond_idx = brk.getBondIdx();
+			pending.ion_root        = node.ion->getAtomWithIdx(ion_root_idx);
+			pending.nl_root         = bond->getOtherAtom(pending.ion_root);
+
+			FeatureVector *fv            = fc.computeFeatureVector(t.getIon(), t.getNeutralLoss(), nullptr);
+			FeatureVector *fv_from_break = fc.computeFeatureVectorFromBreak(pending);
+			BOOST_CHECK(fv->equals(*fv_from_break));
+			delete fv;
+			delete fv_from_break;
+		}
+		node.undoBreak(brk, 0);
+	}
+	if (depth > 1)
+		for (auto &child : node.children) checkBreakFeatures(child, fc, depth - 1);
+}
+
+BOOST_AUTO_TEST_SUITE(BreakFeatureTests)
+
+BOOST_DATA_TEST_CASE(FeaturesFromBreakMatchChildren, bdata::make(break_feature_test_molecules), smiles_or_inchi) {
+	std::vector<std::string> feature_list{"BreakAtomPair",  "IonRootPairs",  "NLRootPairs",
+	                                      "IonRootTriples", "NLRootTriples", "BrokenOrigBondType",
+	                                      "BreakHistoryFeature"};
+	FeatureCalculator fc(feature_list);
+
+	// (with a feature helper for the features, so the ions get their bond types and break histories)
+	FragmentGraphGenerator fgen(&fc);
+	FragmentTreeNode *node = fgen.createStartNode(smiles_or_inchi, POSITIVE_ESI_IONIZATION_MODE);
+
+	// Down to the children's breaks, so the break histories aren't empty
+	checkBreakFeatures(*node, fc, 2);
+	delete node;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,90 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# DeduplicationTests.cpp
+#
+# Description: Tests that inputs for the same structure (however written,
+#              and whatever their stereochemistry) give the same graphs, so
+#              can share one prediction
+#
+#########################################################################*/
+#include <boost/test/unit_test.hpp>
+
+#include "FragGenTestsUtils.h"
+#include "PredictionDeduplicator.h"
+
+// Pairs of stereoisomers: alanine, crotonic acid and glucose / galactose
+std::vector<std::string> dedup_test_molecules{"C[C@H](N)C(=O)O",
+                                              "C[C@@H](N)C(=O)O",
+                                              "C/C=C/C(=O)O",
+                                              "C/C=C\\C(=O)O",
+                                              "OC[C@H]1OC(O)[C@H](O)[C@@H](O)[C@@H]1O",
+                                              "OC[C@H]1OC(O)[C@H](O)[C@@H](O)[C@H]1O"};
+
+// Pairs of smiles for the same molecule: acetic acid, salicylic acid (aromatic and Kekule), caffeine and
+// ethanol (hydrogens in brackets)
+std::vector<std::string> rewritten_test_molecules{"OC(=O)C",
+                                                  "CC(O)=O",
+                                                  "Oc1ccccc1C(=O)O",
+                                                  "OC(=O)C1=CC=CC=C1O",
+                                                  "CN1C=NC2=C1C(=O)N(C(=O)N2C)C",
+                                                  "Cn1c(=O)c2c(ncn2C)n(C)c1=O",
+                                                  "OCC",
+                                                  "[CH3][CH2][OH]"};
+
+BOOST_AUTO_TEST_SUITE(DeduplicationTests)
+
+BOOST_AUTO_TEST_CASE(RewrittenSmilesGiveIdenticalGraphs) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	for (unsigned int i = 0; i < rewritten_test_molecules.size(); i += 2) {
+		FragmentGraph *graph           = getLikelyTestGraph(rewritten_test_molecules[i], cfg, *param);
+		FragmentGraph *rewritten_graph = getLikelyTestGraph(rewritten_test_molecules[i + 1], cfg, *param);
+		checkGraphsEqual(*rewritten_graph, *graph);
+		delete rewritten_graph;
+		delete graph;
+	}
+	delete param;
+}
+
+BOOST_AUTO_TEST_CASE(StereoisomersGiveIdenticalGraphs) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	for (unsigned int i = 0; i < dedup_test_molecules.size(); i += 2) {
+		BOOST_CHECK_EQUAL(FragmentGraphGenerator::getCanonicalNonStereoSmiles(dedup_test_molecules[i]),
+		                  FragmentGraphGenerator::getCanonicalNonStereoSmiles(dedup_test_molecules[i + 1]));
+		FragmentGraph *graph        = getLikelyTestGraph(dedup_test_molecules[i], cfg, *param);
+		FragmentGraph *isomer_graph = getLikelyTestGraph(dedup_test_molecules[i + 1], cfg, *param);
+		checkGraphsEqual(*isomer_graph, *graph);
+		delete isomer_graph;
+		delete graph;
+	}
+	delete param;
+}
+
+BOOST_AUTO_TEST_CASE(SharedSpectraMatchPredicted) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	// As cfm-predict does with deduplicate_inputs on, against predicting every input
+	PredictionDeduplicator dedup(dedup_test_molecules.size());
+	for (auto &smiles_or_inchi : dedup_test_molecules) {
+		std::vector<Spectrum> spectra;
+		PredictionDeduplicator::claim_t claim =
+		    dedup.claimOrFetch(FragmentGraphGenerator::getCanonicalNonStereoSmiles(smiles_or_inchi), spectra);
+		if (claim) {
+			spectra = predictTestSpectra(smiles_or_inchi, cfg, *param);
+			claim->set_value(spectra);
+		}
+		checkSpectraEqual(spectra, predictTestSpectra(smiles_or_inchi, cfg, *param));
+	}
+	BOOST_CHECK_EQUAL(dedup.getNumShared(), (long)dedup_test_molecules.size() / 2);
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
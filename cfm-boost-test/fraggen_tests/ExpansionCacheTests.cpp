@@ -0,0 +1,78 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# ExpansionCacheTests.cpp
+#
+# Description: Tests that taking children from the fragment expansion cache
+#              gives the same graphs as breaking the fragments again
+#
+#########################################################################*/
+#include <boost/test/unit_test.hpp>
+
+#include "FragGenTestsUtils.h"
+#include "FragmentExpansionCache.h"
+
+// (homologues, whose shared fragments are numbered alike, so fragments of one can be taken from the cache
+// for another)
+std::vector<std::string> expansion_cache_test_molecules{"Oc1ccccc1C(=O)OCC", "Oc1ccccc1C(=O)OC", "Oc1ccccc1C(=O)OCCC",
+                                                        "CCOC(=O)CC",        "CCOC(=O)C",        "NC(CCC(=O)O)C(=O)O",
+                                                        "NC(CC(=O)O)C(=O)O"};
+
+// Low enough that most fragments are broken, so there is plenty to share
+static const double expansion_cache_test_prob_thresh = 1e-6;
+
+// Generate the graphs for the given molecules in turn, checking each against its expected graph, and
+// return the number of expansion cache hits
+static long generateCachedGraphs(const std::vector<unsigned int> &molecule_idxs, config_t &cfg, Param &param,
+                                 const std::vector<FragmentGraph *> &expected_graphs) {
+	long prev_hits = FragmentExpansionCache::getNumHits();
+	for (auto i : molecule_idxs) {
+		FragmentGraph *graph =
+		    getLikelyTestGraph(expansion_cache_test_molecules[i], cfg, param, expansion_cache_test_prob_thresh);
+		checkGraphsEqual(*graph, *expected_graphs[i]);
+		delete graph;
+	}
+	return FragmentExpansionCache::getNumHits() - prev_hits;
+}
+
+BOOST_AUTO_TEST_SUITE(ExpansionCacheTests)
+
+BOOST_AUTO_TEST_CASE(CachedGraphsMatchUncached) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	std::vector<FragmentGraph *> expected_graphs;
+	std::vector<unsigned int> all_idxs;
+	for (unsigned int i = 0; i < expansion_cache_test_molecules.size(); i++) {
+		expected_graphs.push_back(
+		    getLikelyTestGraph(expansion_cache_test_molecules[i], cfg, *param, expansion_cache_test_prob_thresh));
+		all_idxs.push_back(i);
+	}
+	cfg.fragment_expansion_cache_size = 100000;
+
+	// The hits each molecule gets from its own fragments, starting from an empty cache
+	long own_hits = 0;
+	for (auto i : all_idxs) {
+		FragmentExpansionCache::clear();
+		own_hits += generateCachedGraphs({i}, cfg, *param, expected_graphs);
+	}
+
+	// The first time through, anything more than that was taken from another molecule
+	FragmentExpansionCache::clear();
+	long first_hits = generateCachedGraphs(all_idxs, cfg, *param, expected_graphs);
+	BOOST_TEST_MESSAGE("First pass: " << first_hits << " expansion cache hits, " << own_hits
+	                                  << " of them within a molecule");
+	BOOST_CHECK_GT(first_hits, own_hits);
+
+	// The second time through, fragments come from the cache throughout
+	long second_hits = generateCachedGraphs(all_idxs, cfg, *param, expected_graphs);
+	BOOST_TEST_MESSAGE("Second pass: " << second_hits << " expansion cache hits");
+	BOOST_CHECK_GT(second_hits, first_hits);
+
+	FragmentExpansionCache::clear();
+	for (auto graph : expected_graphs) delete graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -11,6 +11,8 @@
 #include "FragGenTestsUtils.h"
 #include "FeatureCalculator.h"
 
+#include <boost/test/unit_test.hpp>
+
 FragmentGraph *getTestGraph(std::string smiles_or_inchi, int ionization_mode, bool include_h_loss,
                             bool allow_frag_detours, int graph_depth) {
 	// Run the fragmentation procedure
@@ -31,3 +33,82 @@ FragmentGraph *getTestGraph(std::string smiles_or_inchi, int ionization_mode, bo
 	delete startNode;
 	return graph;
 }
+
+void getTestConfig(config_t &cfg) {
+	std::string config_file = "./bin/test_data/example_param_config.txt";
+	initConfig(cfg, config_file, nullptr, false);
+}
+
+Param *getTestParam(config_t &cfg) {
+	std::string config_file = "./bin/test_data/example_feature_config.txt";
+	FeatureCalculator fc(config_file);
+	auto param = new Param(fc.getFeatureNames(), cfg.spectrum_depths.size());
+	param->initWeights(PARAM_RANDOM_INIT);
+	return param;
+}
+
+std::vector<Spectrum> predictTestSpectra(std::string smiles_or_inchi, config_t &cfg, Param &param,
+                                         double prob_thresh_for_prune) {
+	LikelyFragmentGraphGenerator fgen(&param, &cfg, prob_thresh_for_prune);
+	MolData mol_data("NullId", smiles_or_inchi.c_str(), &cfg);
+	mol_data.computeLikelyFragmentGraphAndSetThetas(fgen, false);
+	mol_data.computePredictedSpectra(param, true, -1, cfg.default_predicted_peak_min, cfg.default_predicted_peak_max,
+	                                 cfg.default_postprocessing_energy, cfg.default_predicted_min_intensity,
+	                                 cfg.default_mz_decimal_place, cfg.use_log_scale_peak);
+	return *mol_data.getPredictedSpectra();
+}
+
+FragmentGraph *getLikelyTestGraph(std::string smiles_or_inchi, config_t &cfg, Param &param,
+                                  double prob_thresh_for_prune) {
+	LikelyFragmentGraphGenerator fgen(&param, &cfg, prob_thresh_for_prune);
+	FragmentGraph *graph        = fgen.createNewGraph(&cfg);
+	FragmentTreeNode *startNode = fgen.createStartNode(smiles_or_inchi, cfg.ionization_mode);
+	try {
+		fgen.compute(*startNode, cfg.fg_depth, -1, 0.0, cfg.max_ring_breaks);
+	} catch (...) {
+		delete startNode;
+		delete graph;
+		throw;
+	}
+	delete startNode;
+	return graph;
+}
+
+void checkSpectraEqual(const std::vector<Spectrum> &spectra, const std::vector<Spectrum> &expected_spectra) {
+	double tolerance = 1e-6;
+
+	BOOST_REQUIRE_EQUAL(spectra.size(), expected_spectra.size());
+	for (size_t energy = 0; energy < spectra.size(); energy++) {
+		BOOST_REQUIRE_EQUAL(spectra[energy].size(), expected_spectra[energy].size());
+		for (unsigned int i = 0; i < spectra[energy].size(); i++) {
+			BOOST_CHECK_CLOSE_FRACTION(spectra[energy].getPeak(i)->mass, expected_spectra[energy].getPeak(i)->mass,
+			                           tolerance);
+			BOOST_CHECK_CLOSE_FRACTION(spectra[energy].getPeak(i)->intensity,
+			                           expected_spectra[energy].getPeak(i)->intensity, tolerance);
+		}
+	}
+}
+
+void checkGraphsEqual(const FragmentGraph &graph, const FragmentGraph &expected_graph) {
+	double tolerance = 1e-6;
+
+	BOOST_REQUIRE_EQUAL(graph.getNumFragments(), expected_graph.getNumFragments());
+	for (unsigned int i = 0; i < graph.getNumFragments(); i++) {
+		BOOST_CHECK_EQUAL(*graph.getFragmentAtIdx(i)->getIonSmiles(),
+		                  *expected_graph.getFragmentAtIdx(i)->getIonSmiles());
+		BOOST_CHECK_CLOSE_FRACTION(graph.getFragmentAtIdx(i)->getMass(), expected_graph.getFragmentAtIdx(i)->getMass(),
+		                           tolerance);
+	}
+
+	BOOST_REQUIRE_EQUAL(graph.getNumTransitions(), expected_graph.getNumTransitions());
+	for (unsigned int i = 0; i < graph.getNumTransitions(); i++) {
+		auto t          = graph.getTransitionAtIdx(i);
+		auto expected_t = expected_graph.getTransitionAtIdx(i);
+		BOOST_CHECK_EQUAL(t->getFromId(), expected_t->getFromId());
+		BOOST_CHECK_EQUAL(t->getToId(), expected_t->getToId());
+		BOOST_REQUIRE_EQUAL(t->getTmpThetas()->size(), expected_t->getTmpThetas()->size());
+		for (size_t energy = 0; energy < t->getTmpThetas()->size(); energy++)
+			BOOST_CHECK_CLOSE_FRACTION((*t->getTmpThetas())[energy], (*expected_t->getTmpThetas())[energy],
+			                           tolerance);
+	}
+}
@@ -10,6 +10,8 @@
 #########################################################################*/
 
 #include "MolData.h"
+#include "Param.h"
+#include "Spectrum.h"
 
 #include <GraphMol/MolOps.h>
 #include <GraphMol/RWMol.h>
@@ -22,4 +24,23 @@
 FragmentGraph *getTestGraph(std::string smiles_or_inchi, int ionization_mode, bool include_h_loss = true,
                             bool allow_frag_detours = false, int graph_depth = 2);
 
+// Config for predicting with the test model (read from the example param config)
+void getTestConfig(config_t &cfg);
+
+// A model with random weights for the features in the example feature config
+Param *getTestParam(config_t &cfg);
+
+// Predict the spectra for a molecule, as cfm-predict does
+std::vector<Spectrum> predictTestSpectra(std::string smiles_or_inchi, config_t &cfg, Param &param,
+                                         double prob_thresh_for_prune = 0.001);
+
+// Compute the likely fragment graph (with thetas) for a molecule - responsibility of caller to delete
+FragmentGraph *getLikelyTestGraph(std::string smiles_or_inchi, config_t &cfg, Param &param,
+                                  double prob_thresh_for_prune = 0.001);
+
+void checkSpectraEqual(const std::vector<Spectrum> &spectra, const std::vector<Spectrum> &expected_spectra);
+
+// Check two graphs have the same fragments and transitions, with the same ids and thetas
+void checkGraphsEqual(const FragmentGraph &graph, const FragmentGraph &expected_graph);
+
 #endif // CFM_FRAGGENTESTSUTILS_H
@@ -0,0 +1,43 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentDedupTests.cpp
+#
+# Description: Tests that identifying fragments by their canonical reduced
+#              smiles agrees with substructure matching
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+
+std::vector<std::string> fragment_dedup_test_molecules{"CC(=O)O",
+                                                       "NC(CCC(=O)O)C(=O)O",
+                                                       "Oc1ccccc1C(=O)OCC",
+                                                       "CN1C=NC2=C1C(=O)N(C(=O)N2C)C",
+                                                       "CC(C)Cc1ccc(cc1)C(C)C(=O)O",
+                                                       "CCOP(=O)(OCC)SCCN",
+                                                       "OC[C@H]1OC(O)[C@H](O)[C@@H](O)[C@@H]1O"};
+
+BOOST_AUTO_TEST_SUITE(FragmentDedupTests)
+
+BOOST_DATA_TEST_CASE(VerifiedDedupMatchesUnverified, bdata::make(fragment_dedup_test_molecules), smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	FragmentGraph *graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+
+	cfg.verify_fragment_dedup     = true;
+	FragmentGraph *verified_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+	BOOST_CHECK_EQUAL(verified_graph->getNumDedupMismatches(), 0);
+	checkGraphsEqual(*verified_graph, *graph);
+
+	delete verified_graph;
+	delete graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,149 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# MILPSolverTests.cpp
+#
+# Description: Differential tests of the combinatorial electron pair
+#              solver against lp_solve, and tests of the solution cache
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+#include "MILP.h"
+
+std::vector<std::string> milp_test_molecules{"CC(=O)O",
+                                             "C1=CN=CN=C1",
+                                             "CC=[N+]=[N-]",
+                                             "C#CC#CC#CCCCCCCOCCCCCCCN",
+                                             "Oc1ccccc1C(=O)O",
+                                             "NC(CCC(=O)O)C(=O)O",
+                                             "CN1C=NC2=C1C(=O)N(C(=O)N2C)C"};
+
+// Check an allocation is a feasible and complete solution of the model: every
+// bond, ring, valence and lone pair constraint holds, and the objective is its total
+void checkSolutionSatisfiesModel(const MILP &solver) {
+	const milp_solution_t &solution = solver.getSolution();
+	if (!solution.optimal) return;
+
+	int total = 0;
+	for (auto value : solution.values) {
+		BOOST_CHECK_GE(value, 0);
+		total += value;
+	}
+	BOOST_CHECK_EQUAL(total, solution.objective);
+	for (auto &constraint : solver.getConstraints()) {
+		int sum = 0;
+		for (auto col : constraint.cols) sum += solution.values[col - 1];
+		if (constraint.ge)
+			BOOST_CHECK_GE(sum, constraint.limit);
+		else
+			BOOST_CHECK_LE(sum, constraint.limit);
+	}
+}
+
+// Solve every model, rather than taking solutions from the cache
+struct MILPSolverFixture {
+	MILPSolverFixture() { MILPSolutionCache::setEnabled(false); }
+	~MILPSolverFixture() { MILPSolutionCache::setEnabled(true); };
+};
+
+BOOST_FIXTURE_TEST_SUITE(MILPSolverDifferentialTests, MILPSolverFixture)
+
+BOOST_DATA_TEST_CASE(MaxElectronsMatchLpSolve, bdata::make(milp_test_molecules), smiles_or_inchi) {
+	int num_models = 0, num_fallbacks = 0;
+	FragmentGraphGenerator fgen(0);
+	FragmentTreeNode *node = fgen.createStartNode(smiles_or_inchi, POSITIVE_ESI_IONIZATION_MODE);
+
+	std::vector<Break> breaks;
+	node->generateBreaks(breaks, true, false);
+	for (auto &brk : breaks) {
+		int isringbrk   = brk.isRingBreak();
+		int brk_ringidx = isringbrk * brk.getRingIdx() - (1 - isringbrk);
+		for (int ifrag_idx = 0; ifrag_idx < brk.getNumIonicFragAllocations(); ifrag_idx++) {
+			node->applyBreak(brk, ifrag_idx);
+			for (int fragidx = 0; fragidx <= 1; fragidx++) {
+				for (int allow_rearrangement = 0; allow_rearrangement <= 1; allow_rearrangement++) {
+					for (int max_free_pairs = 0; max_free_pairs <= 12; max_free_pairs += 3) {
+						std::vector<int> lp_bmax, combinatorial_bmax;
+						MILP lp_solver(node->ion.get(), node->getLabels(), fragidx, brk_ringidx, false);
+						int lp_max_e = lp_solver.runSolver(lp_bmax, true, max_free_pairs, allow_rearrangement,
+						                                   MILP_SOLVER_LP_SOLVE);
+						MILP combinatorial_solver(node->ion.get(), node->getLabels(), fragidx, brk_ringidx, false);
+						int combinatorial_max_e =
+						    combinatorial_solver.runSolver(combinatorial_bmax, true, max_free_pairs,
+						                                   allow_rearrangement, MILP_SOLVER_COMBINATORIAL);
+						BOOST_CHECK_EQUAL(lp_max_e, combinatorial_max_e);
+						BOOST_CHECK_EQUAL(lp_solver.getSolution().optimal, combinatorial_solver.getSolution().optimal);
+						checkSolutionSatisfiesModel(lp_solver);
+						checkSolutionSatisfiesModel(combinatorial_solver);
+						num_models++;
+						if (combinatorial_solver.getSolverUsed() != MILP_SOLVER_COMBINATORIAL) num_fallbacks++;
+					}
+				}
+			}
+			node->undoBreak(brk, ifrag_idx);
+		}
+	}
+	delete node;
+
+	// Most models should be solved without falling back to lp_solve
+	BOOST_CHECK_GT(num_models, 0);
+	BOOST_CHECK_LT(2 * num_fallbacks, num_models);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(MILPSolutionCacheTests)
+
+BOOST_DATA_TEST_CASE(RepeatedSolveIsAHit, bdata::make(milp_test_molecules), smiles_or_inchi) {
+	FragmentGraphGenerator fgen(0);
+	FragmentTreeNode *node = fgen.createStartNode(smiles_or_inchi, POSITIVE_ESI_IONIZATION_MODE);
+
+	std::vector<Break> breaks;
+	node->generateBreaks(breaks, true, false);
+	for (auto &brk : breaks) {
+		int isringbrk   = brk.isRingBreak();
+		int brk_ringidx = isringbrk * brk.getRingIdx() - (1 - isringbrk);
+		node->applyBreak(brk, 0);
+		for (int fragidx = 0; fragidx <= 1; fragidx++) {
+			for (int solver : {MILP_SOLVER_LP_SOLVE, MILP_SOLVER_COMBINATORIAL}) {
+				std::vector<int> bmax, cached_bmax;
+				MILP first_solver(node->ion.get(), node->getLabels(), fragidx, brk_ringidx, false);
+				int max_e = first_solver.runSolver(bmax, true, 0, false, solver);
+
+				// The same model again comes from the cache, with the same solution
+				long prev_hits = MILPSolutionCache::getNumHits();
+				MILP second_solver(node->ion.get(), node->getLabels(), fragidx, brk_ringidx, false);
+				int cached_max_e = second_solver.runSolver(cached_bmax, true, 0, false, solver);
+				BOOST_CHECK_EQUAL(MILPSolutionCache::getNumHits(), prev_hits + 1);
+				BOOST_CHECK_EQUAL(cached_max_e, max_e);
+				BOOST_CHECK_EQUAL_COLLECTIONS(cached_bmax.begin(), cached_bmax.end(), bmax.begin(), bmax.end());
+			}
+		}
+		node->undoBreak(brk, 0);
+	}
+	delete node;
+}
+
+BOOST_DATA_TEST_CASE(WarmCacheGraphMatchesCold, bdata::make(milp_test_molecules), smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	MILPSolutionCache::clear();
+	FragmentGraph *cold_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+
+	long prev_hits            = MILPSolutionCache::getNumHits();
+	FragmentGraph *warm_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+	BOOST_CHECK_GT(MILPSolutionCache::getNumHits(), prev_hits);
+	checkGraphsEqual(*warm_graph, *cold_graph);
+
+	delete warm_graph;
+	delete cold_graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,45 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# ParallelFragGenTests.cpp
+#
+# Description: Tests that generating sibling fragments as parallel tasks
+#              gives the same graph as generating them one at a time
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+
+#include "omp.h"
+
+std::vector<std::string> parallel_fraggen_test_molecules{"NC(CCC(=O)O)C(=O)O", "Oc1ccccc1C(=O)OCC",
+                                                         "CN1C=NC2=C1C(=O)N(C(=O)N2C)C",
+                                                         "CC(C)Cc1ccc(cc1)C(C)C(=O)O"};
+
+BOOST_AUTO_TEST_SUITE(ParallelFragGenTests)
+
+BOOST_DATA_TEST_CASE(ParallelGraphMatchesSerial, bdata::make(parallel_fraggen_test_molecules), smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	FragmentGraph *serial_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+
+	cfg.parallel_fragment_expansion = true;
+	int prev_num_threads            = omp_get_max_threads();
+	for (int num_threads : {1, 2, 4, 8}) {
+		omp_set_num_threads(num_threads);
+		FragmentGraph *parallel_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+		checkGraphsEqual(*parallel_graph, *serial_graph);
+		delete parallel_graph;
+	}
+	omp_set_num_threads(prev_num_threads);
+
+	delete serial_graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,73 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# PredictorTests.cpp
+#
+# Description: Tests that predicting through a Predictor gives the same
+#              spectra as cfm-predict's path, from any number of threads
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+#include "Predictor.h"
+
+#include <GraphMol/SmilesParse/SmilesParse.h>
+
+std::vector<std::string> predictor_test_molecules{"CC(=O)O", "NC(CCC(=O)O)C(=O)O", "Oc1ccccc1C(=O)O",
+                                                  "CN1C=NC2=C1C(=O)N(C(=O)N2C)C"};
+
+struct PredictorFixture {
+	PredictorFixture() {
+		getTestConfig(cfg);
+		param          = getTestParam(cfg);
+		param_filename = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+		param->saveToFile(param_filename);
+		predictor = loadModel(param_filename, config_filename);
+	}
+	~PredictorFixture() {
+		boost::filesystem::remove(param_filename);
+		delete param;
+	};
+	config_t cfg;
+	Param *param;
+	std::string param_filename;
+	std::string config_filename = "./bin/test_data/example_param_config.txt";
+	std::shared_ptr<Predictor> predictor;
+};
+
+BOOST_FIXTURE_TEST_SUITE(PredictorTests, PredictorFixture)
+
+BOOST_AUTO_TEST_CASE(PredictMatchesMolData) {
+	for (auto &smiles_or_inchi : predictor_test_molecules)
+		checkSpectraEqual(predictor->predict(smiles_or_inchi), predictTestSpectra(smiles_or_inchi, cfg, *param));
+}
+
+BOOST_AUTO_TEST_CASE(PredictFromSeveralThreads) {
+	std::vector<std::vector<Spectrum>> expected_spectra;
+	for (auto &smiles_or_inchi : predictor_test_molecules)
+		expected_spectra.push_back(predictTestSpectra(smiles_or_inchi, cfg, *param));
+
+	// Each molecule several times over, so the pooled generators are reused
+	int num_predictions = 4 * predictor_test_molecules.size();
+	std::vector<std::vector<Spectrum>> spectra(num_predictions);
+#pragma omp parallel for num_threads(4)
+	for (int i = 0; i < num_predictions; i++)
+		spectra[i] = predictor->predict(predictor_test_molecules[i % predictor_test_molecules.size()]);
+
+	for (int i = 0; i < num_predictions; i++)
+		checkSpectraEqual(spectra[i], expected_spectra[i % expected_spectra.size()]);
+}
+
+BOOST_AUTO_TEST_CASE(PredictAfterFailure) {
+	BOOST_CHECK_THROW(predictor->predict("NotASmiles"), RDKit::SmilesParseException);
+	checkSpectraEqual(predictor->predict("CC(=O)O"), predictTestSpectra("CC(=O)O", cfg, *param));
+}
+
+BOOST_AUTO_TEST_CASE(MissingModelFile) {
+	BOOST_CHECK_THROW(Predictor("./bin/test_data/no_such_param.log", config_filename), PredictorFileException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,52 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# RingPerceptionTests.cpp
+#
+# Description: Tests that the rings derived for fragments from their parents
+#              are those full perception finds, for polycyclic molecules
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+
+// Adamantane, decalin, a naphthol and testosterone (a steroid core)
+std::vector<std::string> ring_perception_test_molecules{"C1C2CC3CC1CC(C2)C3", "C1CCC2CCCCC2C1", "Oc1ccc2ccccc2c1",
+                                                        "CC12CCC3C(C1CCC2O)CCC4=CC(=O)CCC34C"};
+
+BOOST_AUTO_TEST_SUITE(RingPerceptionTests)
+
+BOOST_DATA_TEST_CASE(VerifiedRingsMatchPerceived, bdata::make(ring_perception_test_molecules), smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	FragmentGraph *sssr_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+
+	// Any fragment whose derived rings differ from those perceived throws
+	cfg.ring_perception           = RING_PERCEPTION_VERIFY;
+	FragmentGraph *verified_graph = nullptr;
+	BOOST_REQUIRE_NO_THROW(verified_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param));
+
+	// (the rings may be found in a different order, so the fragments may be too)
+	BOOST_CHECK_EQUAL(verified_graph->getNumFragments(), sssr_graph->getNumFragments());
+	BOOST_CHECK_EQUAL(verified_graph->getNumTransitions(), sssr_graph->getNumTransitions());
+
+	delete verified_graph;
+	delete sssr_graph;
+	delete param;
+}
+
+// cfm-predict reports and skips a molecule on any runtime_error, so a mismatch mustn't escape that
+BOOST_AUTO_TEST_CASE(MismatchIsReportedAsRuntimeError) {
+	std::string reported;
+	try {
+		throw RingPerceptionMismatchException("C1CC2CC12");
+	} catch (std::runtime_error &e) { reported = e.what(); }
+	BOOST_CHECK_NE(reported.find("C1CC2CC12"), std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
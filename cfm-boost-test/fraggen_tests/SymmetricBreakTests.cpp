@@ -0,0 +1,41 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# SymmetricBreakTests.cpp
+#
+# Description: Tests that merging symmetric breaks gives the same graphs
+#              and spectra as breaking every bond
+#
+#########################################################################*/
+#include <boost/test/data/test_case.hpp>
+#include <boost/test/unit_test.hpp>
+namespace bdata = boost::unit_test::data;
+
+#include "FragGenTestsUtils.h"
+
+std::vector<std::string> symmetric_break_test_molecules{"c1ccccc1C(C)(C)C", "CC(C)(C)O", "OC(=O)CC(O)(CC(=O)O)C(=O)O",
+                                                        "OC(c1ccccc1)c1ccccc1"};
+
+BOOST_AUTO_TEST_SUITE(SymmetricBreakTests)
+
+BOOST_DATA_TEST_CASE(MergedBreaksMatchUnmerged, bdata::make(symmetric_break_test_molecules), smiles_or_inchi) {
+	config_t cfg;
+	getTestConfig(cfg);
+	Param *param = getTestParam(cfg);
+
+	FragmentGraph *graph                   = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+	std::vector<Spectrum> expected_spectra = predictTestSpectra(smiles_or_inchi, cfg, *param);
+
+	// Each merged break still gives a transition for every bond it stands for
+	cfg.merge_symmetric_breaks  = true;
+	FragmentGraph *merged_graph = getLikelyTestGraph(smiles_or_inchi, cfg, *param);
+	BOOST_CHECK_EQUAL(merged_graph->getNumFragments(), graph->getNumFragments());
+	BOOST_CHECK_EQUAL(merged_graph->getNumTransitions(), graph->getNumTransitions());
+	checkSpectraEqual(predictTestSpectra(smiles_or_inchi, cfg, *param), expected_spectra);
+
+	delete merged_graph;
+	delete graph;
+	delete param;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,224 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# AsyncOutputWriter.cpp
+#
+# Description: 	Class for writing predicted spectra to file on a
+#				background thread.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+#include "AsyncOutputWriter.h"
+
+#include <iostream>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+
+AsyncOutputWriter::AsyncOutputWriter(const std::string &a_filename, int a_records_per_shard, size_t a_max_queued,
+                                     BatchManifest *a_manifest, const std::string &a_record_separator)
+    : filename(a_filename), records_per_shard(a_records_per_shard), record_separator(a_record_separator),
+      manifest(a_manifest), max_queued(a_max_queued) {
+
+	const manifest_entry_t *last_entry = manifest != nullptr ? manifest->getLastEntry() : nullptr;
+	if (last_entry != nullptr && last_entry->offset >= 0 && !filename.empty()) {
+		shard_idx = last_entry->shard_idx;
+		if (!resumeOutput(last_entry->offset)) throw OutputWriteException();
+		records_in_shard = last_entry->records_in_shard;
+	} else if (!openOutput())
+		throw OutputWriteException();
+	writer = std::thread(&AsyncOutputWriter::writeQueuedRecords, this);
+}
+
+AsyncOutputWriter::~AsyncOutputWriter() {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		closing = true;
+	}
+	queue_not_empty.notify_all();
+	writer.join();
+	closeOutput();
+}
+
+void AsyncOutputWriter::write(std::string record) {
+	output_record_t output_record;
+	output_record.content = std::move(record);
+	enqueue(std::move(output_record));
+}
+
+void AsyncOutputWriter::write(std::string record, const manifest_entry_t &entry) {
+	output_record_t output_record;
+	output_record.content   = std::move(record);
+	output_record.has_entry = manifest != nullptr;
+	output_record.entry     = entry;
+	enqueue(std::move(output_record));
+}
+
+void AsyncOutputWriter::writeToFile(const std::string &record_filename, std::string record) {
+	output_record_t output_record;
+	output_record.filename = record_filename;
+	output_record.content  = std::move(record);
+	enqueue(std::move(output_record));
+}
+
+void AsyncOutputWriter::writeToFile(const std::string &record_filename, std::string record,
+                                    const manifest_entry_t &entry) {
+	output_record_t output_record;
+	output_record.filename  = record_filename;
+	output_record.content   = std::move(record);
+	output_record.has_entry = manifest != nullptr;
+	output_record.entry     = entry;
+	enqueue(std::move(output_record));
+}
+
+void AsyncOutputWriter::skip(const manifest_entry_t &entry) {
+	if (manifest == nullptr) return;
+	output_record_t output_record;
+	output_record.has_content = false;
+	output_record.has_entry   = true;
+	output_record.entry       = entry;
+	enqueue(std::move(output_record));
+}
+
+void AsyncOutputWriter::enqueue(output_record_t &&record) {
+
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	queue_not_full.wait(lock, [this] { return queue.size() < max_queued; });
+	queue.push_back(std::move(record));
+	lock.unlock();
+	queue_not_empty.notify_one();
+}
+
+void AsyncOutputWriter::writeQueuedRecords() {
+
+	while (true) {
+		// Take everything queued, so the manifest is only flushed once per batch of records
+		std::deque<output_record_t> records;
+		{
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_not_empty.wait(lock, [this] { return !queue.empty() || closing; });
+			if (queue.empty()) break; // Closing, and everything has been written
+			records.swap(queue);
+		}
+		queue_not_full.notify_all();
+
+		std::vector<manifest_entry_t> completed;
+		for (auto &record : records) {
+			if (record.has_content && !record.filename.empty()) {
+				std::ofstream record_file(record.filename.c_str());
+				if (!record_file.is_open())
+					std::cerr << "Error: Could not open output file " << record.filename << std::endl;
+				else
+					record_file << record.content;
+			} else if (record.has_content) {
+				if (records_per_shard > 0 && records_in_shard == records_per_shard) {
+					closeOutput();
+					shard_idx++;
+					if (!openOutput())
+						std::cerr << "Error: Could not open output file " << getShardFilename(shard_idx) << std::endl;
+				}
+				if (records_in_shard > 0) {
+					if (out.is_complete()) out << record_separator;
+					shard_offset += record_separator.size();
+				}
+				if (out.is_complete()) out << record.content;
+				records_in_shard++;
+				shard_offset += record.content.size();
+			}
+
+			if (record.has_entry) {
+				record.entry.shard_idx        = shard_idx;
+				record.entry.offset           = filename.empty() ? -1 : shard_offset;
+				record.entry.records_in_shard = records_in_shard;
+				completed.push_back(record.entry);
+			}
+		}
+
+		// Only record molecules as completed once their output is out of our buffers
+		if (!completed.empty()) {
+			if (out.is_complete()) out.flush();
+			if (file.is_open()) file.flush();
+			for (auto &entry : completed) manifest->append(entry);
+			manifest->flush();
+		}
+	}
+}
+
+bool AsyncOutputWriter::openOutput() {
+
+	records_in_shard = 0;
+	shard_offset     = 0;
+	if (filename.empty()) {
+		out.push(std::cout, OUTPUT_WRITE_BUFFER_SIZE);
+		return true;
+	}
+
+	std::string shard_filename = getShardFilename(shard_idx);
+	bool compressed = shard_filename.size() > 3 && shard_filename.substr(shard_filename.size() - 3) == ".gz";
+	file.open(shard_filename.c_str(), compressed ? std::ofstream::out | std::ofstream::binary : std::ofstream::out);
+	if (!file.is_open()) return false;
+
+	if (compressed) out.push(boost::iostreams::gzip_compressor(), OUTPUT_WRITE_BUFFER_SIZE);
+	out.push(file, OUTPUT_WRITE_BUFFER_SIZE);
+	return true;
+}
+
+bool AsyncOutputWriter::resumeOutput(long long offset) {
+
+	std::string shard_filename = getShardFilename(shard_idx);
+	if (shard_filename.size() > 3 && shard_filename.substr(shard_filename.size() - 3) == ".gz") {
+		std::cerr << "Error: Can't resume writing gzip compressed output " << shard_filename << std::endl;
+		return false;
+	}
+
+	// Remove any later shards written by the earlier run
+	if (records_per_shard > 0) {
+		for (int idx = shard_idx + 1; boost::filesystem::exists(getShardFilename(idx)); idx++)
+			boost::filesystem::remove(getShardFilename(idx));
+	}
+
+	boost::system::error_code ec;
+	if (offset > 0 || boost::filesystem::exists(shard_filename))
+		boost::filesystem::resize_file(shard_filename, offset, ec);
+	if (ec) {
+		std::cerr << "Error: Could not truncate output file " << shard_filename << ": " << ec.message() << std::endl;
+		return false;
+	}
+
+	file.open(shard_filename.c_str(), std::ofstream::out | std::ofstream::app);
+	if (!file.is_open()) return false;
+	out.push(file, OUTPUT_WRITE_BUFFER_SIZE);
+	shard_offset = offset;
+	return true;
+}
+
+void AsyncOutputWriter::closeOutput() {
+
+	// Resetting the chain flushes it (and writes the gzip footer)
+	out.reset();
+	if (file.is_open())
+		file.close();
+	else
+		std::cout.flush();
+}
+
+std::string AsyncOutputWriter::getShardFilename(int idx) const {
+
+	if (records_per_shard <= 0) return filename;
+
+	// Insert the shard index before the last extension (ignoring .gz), e.g. my.out.msp.gz -> my.out.3.msp.gz
+	std::string::size_type name_start = filename.find_last_of('/');
+	name_start                        = name_start == std::string::npos ? 0 : name_start + 1;
+	std::string::size_type name_end   = filename.size();
+	if (name_end - name_start > 3 && filename.substr(name_end - 3) == ".gz") name_end -= 3;
+	std::string::size_type ext_start = filename.find_last_of('.', name_end - 1);
+	if (ext_start == std::string::npos || ext_start <= name_start) ext_start = name_end;
+	return filename.substr(0, ext_start) + "." + std::to_string(idx) + filename.substr(ext_start);
+}
@@ -0,0 +1,127 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# AsyncOutputWriter.h
+#
+# Description: 	Class for writing predicted spectra to file on a
+#				background thread.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __ASYNC_OUTPUT_WRITER_H__
+#define __ASYNC_OUTPUT_WRITER_H__
+
+#include "BatchManifest.h"
+
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+static const int OUTPUT_WRITE_BUFFER_SIZE = 1 << 20;
+
+class OutputWriteException : public std::exception {
+
+    virtual const char *what() const noexcept {
+        return "Could not open output file.";
+    }
+};
+
+// Takes records (e.g. the predicted spectra for one molecule) from the
+// prediction threads and writes them from a background thread, through large
+// buffers, so that output (which can be slow on network filesystems) never
+// holds up prediction. Records go to:
+//  - the main output: stdout if no filename is given, else a file that is gzip
+//    compressed if its name ends in .gz, and (if records_per_shard > 0) split
+//    into shards <name>.0.<ext>, <name>.1.<ext>, ... of at most
+//    records_per_shard records each, with record_separator written between
+//    the records of each shard
+//  - or a file of their own (e.g. one .log file per molecule)
+//
+// If given a manifest, records passed with a manifest entry are added to it once
+// they have been written and flushed, and a main output file that the manifest
+// has entries for is resumed: cut back to the size recorded in its last entry
+// (dropping output from after it, and any later shards) and appended to.
+// Resuming isn't possible for gzip compressed output.
+class AsyncOutputWriter {
+public:
+    //Constructor - opens (or resumes) the main output, throwing
+    //OutputWriteException if that fails
+    AsyncOutputWriter(const std::string &a_filename, int a_records_per_shard = 0, size_t a_max_queued = 256,
+                      BatchManifest *a_manifest = nullptr, const std::string &a_record_separator = "");
+
+    AsyncOutputWriter(const AsyncOutputWriter &) = delete;
+
+    AsyncOutputWriter &operator=(const AsyncOutputWriter &) = delete;
+
+    //Writes anything still queued and closes the output
+    ~AsyncOutputWriter();
+
+    //Queue a record for the main output (waits if the queue is full)
+    void write(std::string record);
+
+    void write(std::string record, const manifest_entry_t &entry);
+
+    //Queue a record to be written to a file of its own
+    void writeToFile(const std::string &record_filename, std::string record);
+
+    void writeToFile(const std::string &record_filename, std::string record, const manifest_entry_t &entry);
+
+    //Add an entry to the manifest (in order with the records) for a molecule with no output
+    void skip(const manifest_entry_t &entry);
+
+private:
+    struct output_record_t {
+        std::string filename; // Empty for the main output
+        std::string content;
+        bool has_content = true;
+        bool has_entry = false;
+        manifest_entry_t entry;
+    };
+
+    std::string filename;
+    int records_per_shard;
+    std::string record_separator;
+    int shard_idx = 0;
+    int records_in_shard = 0;
+    long long shard_offset = 0; // Bytes written to the current shard
+    std::ofstream file;
+    boost::iostreams::filtering_ostream out;
+
+    BatchManifest *manifest;
+
+    size_t max_queued;
+    std::deque<output_record_t> queue;
+    bool closing = false;
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty, queue_not_full;
+
+    std::thread writer;
+
+    void enqueue(output_record_t &&record);
+
+    void writeQueuedRecords();
+
+    //Open the main output (or the current shard of it)
+    bool openOutput();
+
+    //Reopen the current shard of the main output for appending, cut back to offset
+    bool resumeOutput(long long offset);
+
+    void closeOutput();
+
+    std::string getShardFilename(int idx) const;
+};
+
+#endif // __ASYNC_OUTPUT_WRITER_H__
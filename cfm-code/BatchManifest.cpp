@@ -0,0 +1,72 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# BatchManifest.cpp
+#
+# Description: 	Append-only record of the molecules completed by a batch
+#				run, so that an interrupted run can be resumed.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "BatchManifest.h"
+
+#include <iostream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+BatchManifest::BatchManifest(const std::string &a_filename) : filename(a_filename) {
+
+	// Read the entries from an earlier run, up to the first incomplete or out of order line
+	std::streamoff valid_size = 0;
+	std::ifstream ifs(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+	if (ifs.is_open()) {
+		std::string line;
+		while (getline(ifs, line)) {
+			manifest_entry_t entry;
+			if (ifs.eof() || !parseEntry(line, entry) || entry.input_idx != num_completed) break;
+			last_entry = entry;
+			num_completed++;
+			valid_size += line.size() + 1;
+		}
+		ifs.close();
+
+		// Cut off anything after the last complete entry, so appends start on a fresh line
+		boost::system::error_code ec;
+		boost::filesystem::resize_file(filename, valid_size, ec);
+		if (ec) {
+			std::cerr << "Could not truncate batch manifest " << filename << ": " << ec.message() << std::endl;
+			throw ManifestOpenException();
+		}
+	}
+
+	file.open(filename.c_str(), std::ofstream::out | std::ofstream::app | std::ofstream::binary);
+	if (!file.is_open()) {
+		std::cerr << "Could not open batch manifest " << filename << std::endl;
+		throw ManifestOpenException();
+	}
+}
+
+void BatchManifest::append(const manifest_entry_t &entry) {
+
+	file << entry.input_idx << "\t" << entry.id << "\t" << entry.shard_idx << "\t" << entry.offset << "\t"
+	     << entry.records_in_shard << "\t" << entry.format_flags << "\t" << entry.precision << "\n";
+	last_entry = entry;
+	num_completed++;
+}
+
+bool BatchManifest::parseEntry(const std::string &line, manifest_entry_t &entry) {
+
+	std::stringstream ss(line);
+	std::string extra;
+	ss >> entry.input_idx >> entry.id >> entry.shard_idx >> entry.offset >> entry.records_in_shard >>
+	    entry.format_flags >> entry.precision;
+	return !ss.fail() && !(ss >> extra);
+}
@@ -0,0 +1,77 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# BatchManifest.h
+#
+# Description: 	Append-only record of the molecules completed by a batch
+#				run, so that an interrupted run can be resumed.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __BATCH_MANIFEST_H__
+#define __BATCH_MANIFEST_H__
+
+#include <fstream>
+#include <string>
+
+class ManifestOpenException : public std::exception {
+
+    virtual const char *what() const noexcept {
+        return "Could not open batch manifest file.";
+    }
+};
+
+// A completed molecule (predicted and written, or failed), and where the
+// output stood once it was done
+struct manifest_entry_t {
+    size_t input_idx = 0;
+    std::string id;
+    int shard_idx = 0;        // Output shard being written
+    long long offset = -1;    // Size of that shard (-1 if the output isn't a single file)
+    int records_in_shard = 0;
+    long format_flags = 0;    // Formatting state of the stream the output is rendered
+    long precision = 6;       // through, which carries over to the next molecule
+};
+
+// One line per completed molecule, appended in input order, and only once its
+// output has been flushed. Molecules 0 .. getNumCompleted()-1 of the input are
+// therefore done, and the outputs can be cut back to the last entry's offset to
+// drop anything written after it. A partial line left by a crash is discarded
+// when the manifest is reopened.
+class BatchManifest {
+public:
+    //Constructor - reads any entries from an earlier run and opens the file for
+    //appending, throws ManifestOpenException on failure
+    explicit BatchManifest(const std::string &a_filename);
+
+    BatchManifest(const BatchManifest &) = delete;
+
+    BatchManifest &operator=(const BatchManifest &) = delete;
+
+    size_t getNumCompleted() const { return num_completed; };
+
+    //The last completed molecule (nullptr if there are none)
+    const manifest_entry_t *getLastEntry() const { return num_completed > 0 ? &last_entry : nullptr; };
+
+    //Add an entry (entries must be appended in input order)
+    void append(const manifest_entry_t &entry);
+
+    void flush() { file.flush(); };
+
+private:
+    std::string filename;
+    std::ofstream file;
+    size_t num_completed = 0;
+    manifest_entry_t last_entry;
+
+    static bool parseEntry(const std::string &line, manifest_entry_t &entry);
+};
+
+#endif // __BATCH_MANIFEST_H__
@@ -65,6 +65,18 @@ void initDefaultConfig(config_t &cfg, char *argv_zero) {
 	cfg.include_h_losses                 = DEFAULT_INCLUDE_H_LOSSES;
 	cfg.include_precursor_h_losses_only  = DEFAULT_INCLUDE_PRECURSOR_H_LOSSES_ONLY;
 	cfg.fragraph_compute_timeout_in_secs = DEFAULT_FRAGGRAPH_COMPUTE_TIMEOUT_IN_SECS;
+	cfg.graph_memory_budget_mb           = 0.0;
+	cfg.verify_fragment_dedup            = false;
+	cfg.milp_solver                      = MILP_SOLVER_LP_SOLVE;
+	cfg.ring_perception                  = RING_PERCEPTION_SSSR;
+	cfg.merge_symmetric_breaks           = false;
+	cfg.prune_breaks_before_children     = false;
+	cfg.deduplicate_inputs               = false;
+	cfg.parallel_fragment_expansion      = false;
+	cfg.use_best_first_fg_gen            = false;
+	cfg.best_first_max_fragments         = 0;
+	cfg.best_first_max_transitions       = 0;
+	cfg.fragment_expansion_cache_size    = 0;
 	cfg.ga_use_best_q                    = DEFAULT_USE_BEST_Q_IN_GA;
 	cfg.ga_sampling_method               = USE_NO_SAMPLING;
 	cfg.ga_sampling_method2              = USE_NO_SAMPLING;
@@ -205,6 +217,30 @@ void initConfig(config_t &cfg, std::string &filename, char *argv_zero, bool repo
 			cfg.include_precursor_h_losses_only = (int)value;
 		else if (name == "fragraph_compute_timeout_in_secs")
 			cfg.fragraph_compute_timeout_in_secs = (int)value;
+		else if (name == "graph_memory_budget_mb")
+			cfg.graph_memory_budget_mb = (double)value;
+		else if (name == "verify_fragment_dedup")
+			cfg.verify_fragment_dedup = (bool)value;
+		else if (name == "milp_solver")
+			cfg.milp_solver = (int)value;
+		else if (name == "ring_perception")
+			cfg.ring_perception = (int)value;
+		else if (name == "merge_symmetric_breaks")
+			cfg.merge_symmetric_breaks = (bool)value;
+		else if (name == "prune_breaks_before_children")
+			cfg.prune_breaks_before_children = (bool)value;
+		else if (name == "deduplicate_inputs")
+			cfg.deduplicate_inputs = (bool)value;
+		else if (name == "parallel_fragment_expansion")
+			cfg.parallel_fragment_expansion = (bool)value;
+		else if (name == "use_best_first_fg_gen")
+			cfg.use_best_first_fg_gen = (bool)value;
+		else if (name == "best_first_max_fragments")
+			cfg.best_first_max_fragments = (int)value;
+		else if (name == "best_first_max_transitions")
+			cfg.best_first_max_transitions = (int)value;
+		else if (name == "fragment_expansion_cache_size")
+			cfg.fragment_expansion_cache_size = (int)value;
 		else if (name == "ga_use_best_q")
 			cfg.ga_use_best_q = (int)value;
 		else if (name == "ga_sampling_method")
@@ -261,6 +297,14 @@ void initConfig(config_t &cfg, std::string &filename, char *argv_zero, bool repo
 	if (cfg.spectrum_depths.size() != cfg.spectrum_weights.size())
 		std::cout << "Warning: Mismatch between size of spectrum depths and weights" << std::endl;
 
+	// Best-first generation visits one node at a time, so it doesn't expand fragments in parallel
+	if (cfg.use_best_first_fg_gen && cfg.parallel_fragment_expansion)
+		std::cout << "Warning: parallel_fragment_expansion is ignored with use_best_first_fg_gen" << std::endl;
+	if (!cfg.use_best_first_fg_gen && (cfg.best_first_max_fragments > 0 || cfg.best_first_max_transitions > 0))
+		std::cout << "Warning: best_first_max_fragments and best_first_max_transitions are ignored without "
+		             "use_best_first_fg_gen"
+		          << std::endl;
+
 	if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION) {
 		if (cfg.theta_nn_layer_act_func_ids.size() < cfg.theta_nn_hlayer_num_nodes.size() + 1) {
 			std::cout << "Warning: Activations function types not specified for all neural net layers, using default "
@@ -312,10 +356,38 @@ void initConfig(config_t &cfg, std::string &filename, char *argv_zero, bool repo
 			if (cfg.include_precursor_h_losses_only) std::cout << " from precursor only";
 			std::cout << std::endl;
 		}
+		if (cfg.fragment_expansion_cache_size > 0)
+			std::cout << "Caching the children of up to " << cfg.fragment_expansion_cache_size << " fragments"
+			          << std::endl;
 		if (cfg.allow_intermediate_peak) std::cout << "Allowing intermediate peaks" << std::endl;
 		if (cfg.allow_cyclization) std::cout << "Allowing cyclization" << std::endl;
 		if (cfg.use_log_scale_peak) std::cout << "Using log scale peak" << std::endl;
 		if (cfg.use_iterative_fg_gen) std::cout << "Using iterative fragmentation graph generation" << std::endl;
+		if (cfg.verify_fragment_dedup) std::cout << "Verifying fragment deduplication" << std::endl;
+		if (cfg.milp_solver == MILP_SOLVER_COMBINATORIAL)
+			std::cout << "Using combinatorial electron pair allocation solver" << std::endl;
+		if (cfg.ring_perception == RING_PERCEPTION_INCREMENTAL)
+			std::cout << "Deriving fragment rings from their parents" << std::endl;
+		else if (cfg.ring_perception == RING_PERCEPTION_VERIFY)
+			std::cout << "Deriving fragment rings from their parents, verified against full perception"
+			          << std::endl;
+		if (cfg.merge_symmetric_breaks) std::cout << "Merging symmetric breaks" << std::endl;
+		if (cfg.prune_breaks_before_children)
+			std::cout << "Pruning unlikely breaks before generating their children" << std::endl;
+		if (cfg.deduplicate_inputs)
+			std::cout << "Predicting inputs that only differ in stereochemistry once" << std::endl;
+		if (cfg.parallel_fragment_expansion && !cfg.use_best_first_fg_gen)
+			std::cout << "Generating fragments in parallel tasks" << std::endl;
+		if (cfg.use_best_first_fg_gen) {
+			std::cout << "Using best-first fragmentation graph generation";
+			if (cfg.best_first_max_fragments > 0) std::cout << " (at most " << cfg.best_first_max_fragments << " fragments)";
+			if (cfg.best_first_max_transitions > 0)
+				std::cout << " (at most " << cfg.best_first_max_transitions << " transitions)";
+			std::cout << std::endl;
+		}
+		if (cfg.graph_memory_budget_mb > 0)
+			std::cout << "Limiting fragmentation graphs in progress to " << cfg.graph_memory_budget_mb << " MB"
+			          << std::endl;
 
 		std::cout << "Predicted peak num limited to [" << cfg.default_predicted_peak_min << ","
 		          << cfg.default_predicted_peak_max << "]" << std::endl;
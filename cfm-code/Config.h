@@ -150,6 +150,18 @@ static const int DEFAULT_OBS_FUNCTION = NORMAL_OBS_FUNCTION;
 // Timeout settings
 static const int DEFAULT_FRAGGRAPH_COMPUTE_TIMEOUT_IN_SECS = -1; //-1 is no timeout.
 
+// Electron pair allocation solvers
+static const int MILP_SOLVER_LP_SOLVE      = 0;
+// Exact combinatorial search, falling back to lp_solve when a model is too large
+static const int MILP_SOLVER_COMBINATORIAL = 1;
+
+// Ring perception for fragments
+static const int RING_PERCEPTION_SSSR        = 0;
+// Carry the parent's rings over to the children, minus any broken ones
+static const int RING_PERCEPTION_INCREMENTAL = 1;
+// As above, but also perceive the rings in full and throw a RingPerceptionMismatchException if they differ
+static const int RING_PERCEPTION_VERIFY      = 2;
+
 // Random Sample settings
 static const int DEFAULT_USE_BEST_Q_IN_GA       = 0;
 static const int USE_NO_SAMPLING                = 0;
@@ -246,6 +258,18 @@ struct config_t {
 	int ga_minibatch_nth_size;
 
 	int fragraph_compute_timeout_in_secs;
+	double graph_memory_budget_mb; // Limit on fragment graphs being computed at once (0 = no limit)
+	bool verify_fragment_dedup;    // Cross-check fragment identities against substructure matching
+	int milp_solver;               // Solver for the electron pair allocations of fragments
+	int ring_perception;           // How the rings of fragments are found
+	bool merge_symmetric_breaks;   // Break only one of each set of symmetric bonds, counting the rest
+	bool prune_breaks_before_children; // Skip breaks whose children can be shown to be unlikely beforehand
+	bool deduplicate_inputs;       // Predict inputs that only differ in stereochemistry once
+	bool parallel_fragment_expansion; // Generate sibling fragments as parallel tasks
+	bool use_best_first_fg_gen;       // Generate the most probable fragments first, within budgets
+	int best_first_max_fragments;     // Fragment budget for best-first generation (0 = default limit)
+	int best_first_max_transitions;   // Transition budget for best-first generation (0 = default limit)
+	int fragment_expansion_cache_size; // Fragments whose children are kept across molecules (0 = off)
 
 	bool disable_cross_val_metrics;
 	bool disable_training_metrics;
@@ -0,0 +1,206 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# ElectronPairSolver.cpp
+#
+# Description: 	Exact combinatorial solver for the electron pair allocation
+#				models built by MILP, used in place of lp_solve.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "ElectronPairSolver.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+ElectronPairSolver::ElectronPairSolver(int a_num_cols, const std::vector<milp_constraint_t> &constraints)
+    : num_cols(a_num_cols), supported(true), infeasible(false), best_total(-1), root_bound(0), num_nodes(0) {
+
+	lower.resize(num_cols, 0);
+	std::vector<int> upper(num_cols, INT_MAX);
+	var_rows.resize(num_cols);
+
+	// Single variable constraints become bounds, the rest are limits on sums
+	std::vector<int> row_marks(num_cols, -1);
+	std::vector<const milp_constraint_t *> rows;
+	for (unsigned int c = 0; c < constraints.size(); c++) {
+		const milp_constraint_t &constraint = constraints[c];
+		int row_idx                         = (int)rows.size();
+		for (auto col : constraint.cols) {
+			if (col < 1 || col > num_cols || row_marks[col - 1] == (int)c) supported = false;
+			else
+				row_marks[col - 1] = (int)c;
+		}
+		if (!supported) return;
+
+		if (constraint.cols.empty()) {
+			if (constraint.ge ? constraint.limit > 0 : constraint.limit < 0) infeasible = true;
+		} else if (constraint.cols.size() == 1) {
+			int j = constraint.cols[0] - 1;
+			if (constraint.ge)
+				lower[j] = std::max(lower[j], constraint.limit);
+			else
+				upper[j] = std::min(upper[j], constraint.limit);
+		} else if (constraint.ge) {
+			supported = false;
+			return;
+		} else {
+			for (auto col : constraint.cols) var_rows[col - 1].push_back(row_idx);
+			rows.push_back(&constraint);
+		}
+	}
+	for (int j = 0; j < num_cols; j++) {
+		if (lower[j] > upper[j]) infeasible = true;
+	}
+
+	residual.resize(rows.size());
+	num_unassigned.resize(rows.size(), 0);
+	for (unsigned int k = 0; k < rows.size(); k++) {
+		residual[k] = rows[k]->limit;
+		for (auto col : rows[k]->cols) residual[k] -= lower[col - 1];
+		if (residual[k] < 0) infeasible = true;
+	}
+	if (infeasible) return;
+
+	// Work with the amount each variable is above its lower bound
+	capacity.resize(num_cols);
+	for (int j = 0; j < num_cols; j++) {
+		if (var_rows[j].empty() && upper[j] == INT_MAX) {
+			supported = false; // Unbounded
+			return;
+		}
+		capacity[j] = upper[j] == INT_MAX ? INT_MAX : upper[j] - lower[j];
+		for (auto k : var_rows[j]) capacity[j] = std::min(capacity[j], residual[k]);
+		if (capacity[j] > 0) {
+			free_vars.push_back(j);
+			for (auto k : var_rows[j]) num_unassigned[k]++;
+		}
+	}
+
+	// Weight the rows so every variable is covered by a total weight of at
+	// least one, greedily taking the row that covers the most for its residual
+	// (a feasible solution of the dual of the LP relaxation). Any such weights
+	// bound the remaining objective by the weighted sum of the residuals.
+	row_weight.assign(rows.size(), 0.0);
+	uncovered.assign(num_cols, 0.0);
+	std::vector<double> need(num_cols, 0.0);
+	for (auto j : free_vars) need[j] = 1.0;
+	while (true) {
+		int best_row = -1;
+		double best_ratio = 0.0;
+		for (unsigned int k = 0; k < rows.size(); k++) {
+			double total_need = 0.0;
+			for (auto col : rows[k]->cols) total_need += need[col - 1];
+			if (total_need < 1e-9) continue;
+			double ratio = residual[k] / total_need;
+			if (best_row < 0 || ratio < best_ratio) {
+				best_row   = k;
+				best_ratio = ratio;
+			}
+		}
+		if (best_row < 0) break;
+		double delta = 1.0;
+		for (auto col : rows[best_row]->cols) {
+			if (need[col - 1] > 1e-9) delta = std::min(delta, need[col - 1]);
+		}
+		row_weight[best_row] += delta;
+		for (auto col : rows[best_row]->cols) need[col - 1] = std::max(0.0, need[col - 1] - delta);
+	}
+	uncovered_capacity = 0.0;
+	for (auto j : free_vars) {
+		uncovered[j] = need[j] * capacity[j];
+		uncovered_capacity += uncovered[j];
+	}
+
+	// Assign the variables in the tightest rows first
+	std::vector<int> tightest(num_cols, INT_MAX);
+	for (auto j : free_vars) {
+		for (auto k : var_rows[j]) tightest[j] = std::min(tightest[j], residual[k]);
+	}
+	std::stable_sort(free_vars.begin(), free_vars.end(), [&](int a, int b) { return tightest[a] < tightest[b]; });
+}
+
+bool ElectronPairSolver::solve(milp_solution_t &solution) {
+
+	if (!supported) return false;
+	if (infeasible) {
+		solution.optimal   = false;
+		solution.objective = 0;
+		solution.values.clear();
+		return true;
+	}
+
+	values.assign(num_cols, 0);
+	best_values = values;
+	best_total  = -1;
+	num_nodes   = 0;
+	root_bound  = computeBound((int)free_vars.size());
+	if (!search(0, 0)) return false;
+
+	solution.optimal   = true;
+	solution.objective = 0;
+	solution.values.resize(num_cols);
+	for (int j = 0; j < num_cols; j++) {
+		solution.values[j] = lower[j] + best_values[j];
+		solution.objective += solution.values[j];
+	}
+	return true;
+}
+
+int ElectronPairSolver::computeBound(int num_remaining) const {
+
+	double bound = uncovered_capacity;
+	for (unsigned int k = 0; k < residual.size(); k++) {
+		if (num_unassigned[k] > 0) bound += row_weight[k] * residual[k];
+	}
+	// Rows still covering every unassigned variable limit the whole remainder
+	for (unsigned int k = 0; k < residual.size(); k++) {
+		if (num_unassigned[k] == num_remaining) bound = std::min(bound, (double)residual[k]);
+	}
+	return (int)std::min(std::floor(bound + 1e-6), (double)INT_MAX);
+}
+
+bool ElectronPairSolver::search(int idx, int total) {
+
+	if (++num_nodes > MAX_ELECTRON_PAIR_SOLVER_NODES) return false;
+
+	int num_remaining = (int)free_vars.size() - idx;
+	if (num_remaining == 0) {
+		if (total > best_total) {
+			best_total  = total;
+			best_values = values;
+		}
+		return true;
+	}
+	if (best_total >= 0 && total + computeBound(num_remaining) <= best_total) return true;
+
+	int j     = free_vars[idx];
+	int max_v = capacity[j];
+	for (auto k : var_rows[j]) max_v = std::min(max_v, residual[k]);
+
+	for (auto k : var_rows[j]) num_unassigned[k]--;
+	uncovered_capacity -= uncovered[j];
+
+	// Try the largest values first, so good allocations are found early
+	bool completed = true;
+	for (int v = max_v; v >= 0 && completed; v--) {
+		values[j] = v;
+		for (auto k : var_rows[j]) residual[k] -= v;
+		completed = search(idx + 1, total + v);
+		for (auto k : var_rows[j]) residual[k] += v;
+		if (best_total >= root_bound) break;
+	}
+
+	values[j] = 0;
+	for (auto k : var_rows[j]) num_unassigned[k]++;
+	uncovered_capacity += uncovered[j];
+	return completed;
+}
@@ -0,0 +1,75 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# ElectronPairSolver.h
+#
+# Description: 	Exact combinatorial solver for the electron pair allocation
+#				models built by MILP, used in place of lp_solve.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __ELECTRON_PAIR_SOLVER_H__
+#define __ELECTRON_PAIR_SOLVER_H__
+
+#include "MILP.h"
+
+#include <vector>
+
+// Give up (and let lp_solve have the model) after searching this many nodes
+static const long MAX_ELECTRON_PAIR_SOLVER_NODES = 100000;
+
+// Maximises the sum of all the variables of a MILP model by depth-first branch
+// and bound. The models only have unit coefficients, single variable lower
+// bounds and otherwise upper limits on sums of variables, which lets the
+// search propagate limits and bound the objective without any LP relaxation.
+// Variables are assigned in order of the smallest limit among the rows they
+// are in (tightest first, then by column), each trying its largest value
+// first, and the first allocation found with the best total is kept. So of
+// several optimal allocations, the one with the largest values in that order
+// is returned, which need not be the one lp_solve picks (and so can change
+// which fragments are generated).
+class ElectronPairSolver {
+public:
+    ElectronPairSolver(int a_num_cols, const std::vector<milp_constraint_t> &constraints);
+
+    // Returns false if the model is outside what the solver handles, or the
+    // search was too large, in which case the solution is left untouched.
+    bool solve(milp_solution_t &solution);
+
+private:
+    int num_cols;
+    bool supported;
+    bool infeasible;
+
+    // Per variable: lower bound, and how far above it the variable may go
+    std::vector<int> lower, capacity;
+    std::vector<std::vector<int> > var_rows;
+
+    // Per multi-variable limit: what is left of the limit, and the number of
+    // variables in it that are not yet assigned
+    std::vector<int> residual, num_unassigned;
+
+    // Weights of the rows for bounding the objective
+    std::vector<double> row_weight;
+    // Per variable: the part of its capacity the row weights don't cover
+    std::vector<double> uncovered;
+    double uncovered_capacity;
+
+    std::vector<int> free_vars, values, best_values;
+    int best_total, root_bound;
+    long num_nodes;
+
+    int computeBound(int num_remaining) const;
+
+    // Returns false if the node limit was reached
+    bool search(int idx, int total);
+};
+
+#endif // __ELECTRON_PAIR_SOLVER_H__
@@ -95,9 +95,26 @@ protected:
     std::string name;
 };
 
+// A child that is yet to be made by breaking a (non-ring) bond of the parent
+// ion: the parent, the broken bond, and the atoms at either end of it on the
+// ion and the neutral loss sides
+struct pending_child_t {
+    romol_ptr_t parent;
+    int broken_bond_idx;
+    RDKit::Atom *ion_root;
+    RDKit::Atom *nl_root;
+};
+
 class BreakFeature: public Feature{
 public:
     virtual void compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const = 0;
+
+    // Whether computeFromBreak gives the same features as compute would for
+    // the child, i.e. the feature only looks at the roots, the atoms reachable
+    // from them and the break itself
+    virtual bool isComputableFromBreak() const { return false; };
+
+    virtual void computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {};
 };
 
 class FragmentFeature: public Feature{
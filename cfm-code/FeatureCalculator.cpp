@@ -15,6 +15,7 @@
 //#########################################################################*/
 
 #include "FeatureCalculator.h"
+#include "PredictionProfile.h"
 #include "Features/BreakAtomPair.h"
 #include "Features/BrokenOrigBondType.h"
 #include "Features/ExtraRingFeatures.h"
@@ -59,12 +60,15 @@
 
 #include <boost/algorithm/string/trim.hpp>
 
+#include <mutex>
+
 const boost::ptr_vector<BreakFeature> &FeatureCalculator::breakFeatureCogs() {
 
     static boost::ptr_vector<BreakFeature> cogs;
-    static bool initialised = false;
+    static std::once_flag initialised;
 
-    if (!initialised) {
+    // call_once so concurrent first calls (e.g. from prediction threads) are safe
+    std::call_once(initialised, [] {
         cogs.push_back(new BreakAtomPair());
         cogs.push_back(new BrokenOrigBondType());
         cogs.push_back(new NeighbourOrigBondTypes());
@@ -130,20 +134,18 @@ const boost::ptr_vector<BreakFeature> &FeatureCalculator::breakFeatureCogs() {
         cogs.push_back(new NLRootMatrixFPN16MoreSymbols());
         cogs.push_back(new IonRootMatrixFPN16MoreSymbols());
         cogs.push_back(new BreakHistoryFeature());
-        initialised = true;
-    }
+    });
     return cogs;
 }
 
 const boost::ptr_vector<FragmentFeature> &FeatureCalculator::fragmentFeatureCogs() {
     static boost::ptr_vector<FragmentFeature> cogs;
-    static bool initialised = false;
+    static std::once_flag initialised;
 
-    if (!initialised) {
+    std::call_once(initialised, [] {
         cogs.push_back(new FragmentFingerPrintFeature());
         cogs.push_back(new FragmentFunctionalGroupFeature());
-        initialised = true;
-    }
+    });
     return cogs;
 }
 
@@ -265,6 +267,7 @@ FeatureVector *
 FeatureCalculator::computeFeatureVector(const RootedROMol *ion, const RootedROMol *nl,
                                         const romol_ptr_t precursor_ion) {
 
+    ProfileStageTimer timer(STAGE_COMPUTE_FEATURES);
     FeatureVector *fv = new FeatureVector();
 
     // Add the Bias Feature
@@ -308,6 +311,75 @@ FeatureCalculator::computeFeatureVector(const RootedROMol *ion, const RootedROMo
     return fv;
 }
 
+FeatureVector *FeatureCalculator::computeFeatureVectorFromBreak(const pending_child_t &child) {
+
+    ProfileStageTimer timer(STAGE_COMPUTE_FEATURES);
+    FeatureVector *fv = new FeatureVector();
+
+    // Add the Bias Feature
+    fv->addFeature(1.0);
+
+    for (const auto &feature_idx : used_break_feature_idxs) {
+        auto feature = &breakFeatureCogs()[feature_idx];
+        if (!feature->isComputableFromBreak()) {
+            fv->addFeatures(std::vector<int>(feature->getSize(), 0));
+            continue;
+        }
+        try {
+            feature->computeFromBreak(*fv, child);
+        } catch (std::exception &e) {
+            std::cout << "Could not compute " << feature->getName()
+                      << std::endl;
+            throw FeatureCalculationException("Could not compute " +
+                                              feature->getName());
+        }
+    }
+
+    for (const auto &feature_idx : used_fragement_feature_idxs) {
+        auto feature = &fragmentFeatureCogs()[feature_idx];
+        fv->addFeatures(std::vector<int>(feature->getSize(), 0));
+    }
+    return fv;
+}
+
+void FeatureCalculator::getIdxRangesNeedingChild(std::vector<std::pair<unsigned int, unsigned int>> &ranges) {
+
+    unsigned int idx = 1; // After the bias
+    for (const auto &feature_idx : used_break_feature_idxs) {
+        auto feature = &breakFeatureCogs()[feature_idx];
+        if (!feature->isComputableFromBreak())
+            ranges.emplace_back(idx, idx + feature->getSize());
+        idx += feature->getSize();
+    }
+}
+
+FeatureVector *FeatureCalculator::computeFragmentFeatureVector(const romol_ptr_t precursor_ion) {
+
+    ProfileStageTimer timer(STAGE_COMPUTE_FEATURES);
+    FeatureVector *fv = new FeatureVector();
+
+    // No Bias
+    fv->addFeature(0.0);
+
+    for (const auto &feature_idx : used_break_feature_idxs) {
+        auto feature = &breakFeatureCogs()[feature_idx];
+        fv->addFeatures(std::vector<int>(feature->getSize(), 0));
+    }
+
+    for (const auto &feature_idx : used_fragement_feature_idxs) {
+        auto feature = &fragmentFeatureCogs()[feature_idx];
+        try {
+            feature->compute(*fv, precursor_ion);
+        } catch (std::exception &e) {
+            std::cout << "Could not compute " << feature->getName()
+                      << std::endl;
+            throw FeatureCalculationException("Could not compute " +
+                                              feature->getName());
+        }
+    }
+    return fv;
+}
+
 bool FeatureCalculator::includesFeature(const std::string &fname) {
     for (auto & f_idx : used_break_feature_idxs) {
         const Feature *cog = &(breakFeatureCogs()[f_idx]);
@@ -81,6 +81,23 @@ public:
 
     bool includesFeature(const std::string &fname);
 
+    // Whether any features are computed from the precursor ion
+    bool usesFragmentFeatures() const { return !used_fragement_feature_idxs.empty(); };
+
+    // For a child that is yet to be made: the features that can be computed
+    // from the parent and the break (see BreakFeature::computeFromBreak), with
+    // all the others left unset. The [begin, end) indexes of the features left
+    // unset that depend on the child are given by getIdxRangesNeedingChild, and
+    // the fragment features by computeFragmentFeatureVector.
+    // - NB: responsibility of caller to delete.
+    FeatureVector *computeFeatureVectorFromBreak(const pending_child_t &child);
+
+    void getIdxRangesNeedingChild(std::vector<std::pair<unsigned int, unsigned int>> &ranges);
+
+    // Just the fragment features (the same for every child of the precursor ion),
+    // with all the others left unset - NB: responsibility of caller to delete.
+    FeatureVector *computeFragmentFeatureVector(const romol_ptr_t precursor_ion);
+
 private:
     // List of feature classes ready to be used
     static const boost::ptr_vector<BreakFeature> &breakFeatureCogs();
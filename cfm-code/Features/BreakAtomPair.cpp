@@ -23,13 +23,22 @@ BreakAtomPair::compute(FeatureVector &fv, const RootedROMol *ion, const RootedRO
 
     int ring_break;
     nl->mol.get()->getProp("IsRingBreak", ring_break);
+    addAtomPairFeatures(fv, ion->root, nl->root, ring_break);
+}
+
+void BreakAtomPair::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+    addAtomPairFeatures(fv, child.ion_root, child.nl_root, 0);
+}
+
+void BreakAtomPair::addAtomPairFeatures(FeatureVector &fv, const RDKit::Atom *ion_root, const RDKit::Atom *nl_root,
+                                        int ring_break) const {
 
     //Ion Symbol
-    std::string ion_root_symbol = ion->root->getSymbol();
+    std::string ion_root_symbol = ion_root->getSymbol();
     replaceUncommonWithX(ion_root_symbol, false);
 
     //Neutral Loss Symbol
-    std::string nl_root_symbol = nl->root->getSymbol();
+    std::string nl_root_symbol = nl_root->getSymbol();
     replaceUncommonWithX(nl_root_symbol, false);
 
     //Pairs
@@ -27,4 +27,12 @@ public:
 
     void
     compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const override;
+
+    bool isComputableFromBreak() const override { return true; };
+
+    void computeFromBreak(FeatureVector &fv, const pending_child_t &child) const override;
+
+private:
+    void addAtomPairFeatures(FeatureVector &fv, const RDKit::Atom *ion_root, const RDKit::Atom *nl_root,
+                             int ring_break) const;
 };
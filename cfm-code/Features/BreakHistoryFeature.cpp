@@ -23,14 +23,30 @@ void BreakHistoryFeature::compute(FeatureVector &fv, const RootedROMol *ion, con
     std::vector<int> history_so_far;
     ion->mol.get()->getProp(history_keyword, history_so_far);
 
+    // we only need the size -1 events, the latest event is current break
+    // thus do not include it
+    addHistoryFeatures(fv, history_so_far, history_so_far.size() - 1);
+}
+
+void BreakHistoryFeature::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+
+    std::string history_keyword = "FragmentationBondHistory";
+
+    std::vector<int> history_so_far;
+    if (child.parent->hasProp(history_keyword))
+        child.parent->getProp(history_keyword, history_so_far);
+    addHistoryFeatures(fv, history_so_far, history_so_far.size());
+}
+
+void BreakHistoryFeature::addHistoryFeatures(FeatureVector &fv, const std::vector<int> &history,
+                                             unsigned int num_events) const {
+
     // we have seven bond types
     int occurs [7] = {0};
 
-    // we only need the size -1 events, the latest event is current break
-    // thus do not include it
-    for(int i = 0 ; i < history_so_far.size() -1 ; ++i){
+    for(int i = 0 ; i < num_events ; ++i){
         // add occurs for each bond type
-        occurs[history_so_far[i] - 1] += 1;
+        occurs[history[i] - 1] += 1;
     }
 
     // This is a number
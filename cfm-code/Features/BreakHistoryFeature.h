@@ -25,8 +25,16 @@ public:
     };
 
     void
-    compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const;
+    compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const override;
+
+    bool isComputableFromBreak() const override { return true; };
+
+    // The earlier events are the whole history of the parent
+    void computeFromBreak(FeatureVector &fv, const pending_child_t &child) const override;
 
 private:
     const int num_encoded_events = 5;
+
+    // Counts the first num_events events of the history
+    void addHistoryFeatures(FeatureVector &fv, const std::vector<int> &history, unsigned int num_events) const;
 };
\ No newline at end of file
@@ -18,6 +18,16 @@
 void BrokenOrigBondType::compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const {
     int bondtype;
     nl->mol.get()->getProp("BrokenOrigBondType", bondtype);
+    addBondTypeFeatures(fv, bondtype);
+}
+
+void BrokenOrigBondType::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+    int bondtype;
+    child.parent->getBondWithIdx(child.broken_bond_idx)->getProp("OrigBondType", bondtype);
+    addBondTypeFeatures(fv, bondtype);
+}
+
+void BrokenOrigBondType::addBondTypeFeatures(FeatureVector &fv, int bondtype) const {
     fv.addFeature(bondtype == 1); //SINGLE
     fv.addFeature(bondtype == 2); //DOUBLE
     fv.addFeature(bondtype == 3); //TRIPLE
@@ -27,4 +27,11 @@ public:
 
     void
     compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const override;
+
+    bool isComputableFromBreak() const override { return true; };
+
+    void computeFromBreak(FeatureVector &fv, const pending_child_t &child) const override;
+
+private:
+    void addBondTypeFeatures(FeatureVector &fv, int bondtype) const;
 };
\ No newline at end of file
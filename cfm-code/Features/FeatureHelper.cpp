@@ -196,8 +196,6 @@ void FeatureHelper::labelOriginalMasses(RDKit::RWMol *rwmol) {
 void FeatureHelper::labelAtomsWithLonePairs(RDKit::RWMol *rwmol) {
     RDKit::PeriodicTable *pt = RDKit::PeriodicTable::getTable();
     RDKit::ROMol::AtomIterator ai;
-    RDKit::MolOps::findSSSR(*rwmol);
-    
     for (ai = rwmol->beginAtoms(); ai != rwmol->endAtoms(); ++ai) {
         std::string symbol = (*ai)->getSymbol();
         int nouter = pt->getNouterElecs(symbol.c_str());
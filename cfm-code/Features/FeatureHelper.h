@@ -41,6 +41,8 @@ public:
     ~FeatureHelperException() noexcept override = default;;
 };
 
+static const unsigned int NUM_FEATURE_HELPER_FLAGS = 6;
+
 class FeatureHelper {
 public:
     FeatureHelper() = default;
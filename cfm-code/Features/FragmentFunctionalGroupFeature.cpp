@@ -26,9 +26,10 @@ param.cpp.
 
 void FragmentFunctionalGroupFeature::compute(FeatureVector &fv, romol_ptr_t precursor_ion) const {
 
-    auto fparams = new RDKit::FragCatParams(FGRPS_PICKLE);
+    // Parsed once and shared by every call, rather than once per transition
+    static const RDKit::FragCatParams fparams(FGRPS_PICKLE);
 
-    for(const auto & fg_param :  fparams->getFuncGroups()){
+    for(const auto & fg_param :  fparams.getFuncGroups()){
 
         std::vector<RDKit::MatchVectType> fgpMatches;
         int has_fg = RDKit::SubstructMatch(*precursor_ion, *fg_param,fgpMatches);
@@ -39,6 +40,4 @@ void FragmentFunctionalGroupFeature::compute(FeatureVector &fv, romol_ptr_t prec
             fv.addFeature(0.0);
         }
     }
-
-    delete fparams;
 }
\ No newline at end of file
@@ -23,4 +23,12 @@ IonRootPairs::compute(FeatureVector &fv, const RootedROMol *ion, const RootedROM
     std::vector<path_t> paths;
     computeRootPaths(paths, ion, 2, false);
     addRootPairFeatures(fv, paths, ring_break);
-}
\ No newline at end of file
+}
+
+void IonRootPairs::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+
+    RootedROMol root(child.parent, child.ion_root);
+    std::vector<path_t> paths;
+    computeRootPaths(paths, &root, 2, false, child.broken_bond_idx);
+    addRootPairFeatures(fv, paths, 0);
+}
@@ -24,4 +24,12 @@ void IonRootTriples::compute(FeatureVector &fv, const RootedROMol *ion, const Ro
     std::vector<path_t> paths;
     computeRootPaths(paths, ion, 3, false);
     addRootTripleFeatures(fv, paths, ring_break);
-}
\ No newline at end of file
+}
+
+void IonRootTriples::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+
+    RootedROMol root(child.parent, child.ion_root);
+    std::vector<path_t> paths;
+    computeRootPaths(paths, &root, 3, false, child.broken_bond_idx);
+    addRootTripleFeatures(fv, paths, 0);
+}
@@ -25,3 +25,11 @@ void NLRootPairs::compute(FeatureVector &fv, const RootedROMol *ion, const Roote
     computeRootPaths(paths, nl, 2, false);
     addRootPairFeatures(fv, paths, ring_break);
 }
+
+void NLRootPairs::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+
+    RootedROMol root(child.parent, child.nl_root);
+    std::vector<path_t> paths;
+    computeRootPaths(paths, &root, 2, false, child.broken_bond_idx);
+    addRootPairFeatures(fv, paths, 0);
+}
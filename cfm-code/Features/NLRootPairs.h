@@ -29,4 +29,8 @@ public:
 
     void
     compute(FeatureVector &fv, const RootedROMol *ion, const RootedROMol *nl) const override;
+
+    bool isComputableFromBreak() const override { return true; };
+
+    void computeFromBreak(FeatureVector &fv, const pending_child_t &child) const override;
 };
\ No newline at end of file
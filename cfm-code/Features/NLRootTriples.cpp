@@ -25,3 +25,11 @@ void NLRootTriples::compute(FeatureVector &fv, const RootedROMol *ion, const Roo
     computeRootPaths(paths, nl, 3, false);
     addRootTripleFeatures(fv, paths, ring_break);
 }
+
+void NLRootTriples::computeFromBreak(FeatureVector &fv, const pending_child_t &child) const {
+
+    RootedROMol root(child.parent, child.nl_root);
+    std::vector<path_t> paths;
+    computeRootPaths(paths, &root, 3, false, child.broken_bond_idx);
+    addRootTripleFeatures(fv, paths, 0);
+}
@@ -21,10 +21,10 @@ param.cpp.
 
 
 void RootPathFeature::computeRootPaths(std::vector<path_t> &paths, const RootedROMol *mol, int len,
-                                       bool with_bond = false) const {
+                                       bool with_bond, int skip_bond_idx) const {
     path_t path_so_far;
     addPathsFromAtom(paths, mol->root, mol->mol, mol->root, path_so_far, len,
-                     with_bond);
+                     with_bond, skip_bond_idx);
 }
 
 void RootPathFeature::addPathsFromAtom(std::vector<path_t> &paths,
@@ -32,7 +32,7 @@ void RootPathFeature::addPathsFromAtom(std::vector<path_t> &paths,
                                        const romol_ptr_t mol,
                                        const RDKit::Atom *prev_atom,
                                        path_t &path_so_far, int len,
-                                       bool with_bond) const {
+                                       bool with_bond, int skip_bond_idx) const {
     // Add the current symbol
     std::string symbol = atom->getSymbol();
     replaceUncommonWithX(symbol, false);
@@ -43,6 +43,9 @@ void RootPathFeature::addPathsFromAtom(std::vector<path_t> &paths,
         RDKit::ROMol::ADJ_ITER_PAIR itp = mol.get()->getAtomNeighbors(atom);
         for (; itp.first != itp.second; ++itp.first) {
             RDKit::Atom *nbr_atom = mol.get()->getAtomWithIdx(*itp.first);
+            if (skip_bond_idx >= 0 &&
+                mol.get()->getBondBetweenAtoms(atom->getIdx(), nbr_atom->getIdx())->getIdx() == skip_bond_idx)
+                continue;
             if (with_bond == true) {
                 int bond_type = 0;
                 mol.get()->getBondBetweenAtoms(atom->getIdx(), nbr_atom->getIdx())->getProp("OrigBondType", bond_type);
@@ -50,7 +53,7 @@ void RootPathFeature::addPathsFromAtom(std::vector<path_t> &paths,
             }
             if (nbr_atom != prev_atom) {
                 addPathsFromAtom(paths, nbr_atom, mol, atom, path_so_far, len - 1,
-                                 with_bond);
+                                 with_bond, skip_bond_idx);
             }
         }
     } else
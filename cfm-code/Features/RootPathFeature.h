@@ -28,7 +28,10 @@ protected:
     typedef std::vector<std::string> path_t;
 
     // function to compute path with given length from a root
-    void computeRootPaths(std::vector<path_t> &paths, const RootedROMol *mol, int len, bool with_bond) const;
+    // (never crossing the bond skip_bond_idx, if one is given, so the paths
+    // from a root in the parent are those the child of breaking it will have)
+    void computeRootPaths(std::vector<path_t> &paths, const RootedROMol *mol, int len, bool with_bond,
+                          int skip_bond_idx = -1) const;
 
     // function to add features with a length of two
     void addRootPairFeatures(FeatureVector &fv, std::vector<path_t> &paths,
@@ -46,5 +49,5 @@ private:
     // function to add path from given atom
     void addPathsFromAtom(std::vector<path_t> &paths, const RDKit::Atom *atom,
                           romol_ptr_t mol, const RDKit::Atom *prev_atom,
-                          path_t &path_so_far, int len, bool with_bond) const;
+                          path_t &path_so_far, int len, bool with_bond, int skip_bond_idx) const;
 };
@@ -0,0 +1,55 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentArena.cpp
+#
+# Description: 	Bump allocator for the scratch storage used while
+#				enumerating fragments.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "FragmentArena.h"
+
+#include <algorithm>
+
+FragmentArena::~FragmentArena() {
+	for (auto &block : blocks) delete[] block.data;
+}
+
+void *FragmentArena::allocate(size_t bytes, size_t alignment) {
+
+	while (true) {
+		if (current_block < blocks.size()) {
+			block_t &block = blocks[current_block];
+			size_t start   = (current_offset + alignment - 1) / alignment * alignment;
+			if (start + bytes <= block.size) {
+				current_offset = start + bytes;
+				return block.data + start;
+			}
+			if (current_offset > 0) {
+				// Move on to the next block
+				current_block++;
+				current_offset = 0;
+				continue;
+			}
+		}
+		// No block left that is large enough, so put a new one in here
+		block_t block;
+		block.size = std::max(FRAGMENT_ARENA_BLOCK_SIZE, bytes + alignment);
+		block.data = new char[block.size];
+		blocks.insert(blocks.begin() + std::min(current_block, blocks.size()), block);
+		current_offset = 0;
+	}
+}
+
+FragmentArena &FragmentArena::forThread() {
+	static thread_local FragmentArena arena;
+	return arena;
+}
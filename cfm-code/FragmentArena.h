@@ -0,0 +1,103 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentArena.h
+#
+# Description: 	Bump allocator for the scratch storage used while
+#				enumerating fragments.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __FRAGMENT_ARENA_H__
+#define __FRAGMENT_ARENA_H__
+
+#include <cstddef>
+#include <vector>
+
+static const size_t FRAGMENT_ARENA_BLOCK_SIZE = 64 * 1024;
+
+// Hands out memory from large blocks, and only takes it back all at once by
+// rewinding to an earlier mark. Each thread has its own arena, so nothing is
+// locked, and the blocks are kept for the next molecule the thread works on.
+class FragmentArena {
+public:
+    struct mark_t {
+        size_t block;
+        size_t offset;
+    };
+
+    FragmentArena() : current_block(0), current_offset(0) {};
+
+    ~FragmentArena();
+
+    FragmentArena(const FragmentArena &) = delete;
+
+    FragmentArena &operator=(const FragmentArena &) = delete;
+
+    void *allocate(size_t bytes, size_t alignment);
+
+    mark_t getMark() const { return mark_t{current_block, current_offset}; };
+
+    // Everything allocated since the mark is released
+    void rewind(const mark_t &mark) {
+        current_block  = mark.block;
+        current_offset = mark.offset;
+    };
+
+    // The arena of the calling thread
+    static FragmentArena &forThread();
+
+private:
+    struct block_t {
+        char *data;
+        size_t size;
+    };
+    std::vector<block_t> blocks;
+    size_t current_block;
+    size_t current_offset;
+};
+
+// Releases everything allocated from the thread's arena during its lifetime,
+// which must therefore be done with by then (scopes nest like the stack)
+class FragmentArenaScope {
+public:
+    FragmentArenaScope() : arena(FragmentArena::forThread()), mark(arena.getMark()) {};
+
+    ~FragmentArenaScope() { arena.rewind(mark); };
+
+private:
+    FragmentArena &arena;
+    FragmentArena::mark_t mark;
+};
+
+// Allocator for standard containers, drawing on the arena of the thread that
+// creates it (deallocation is left to the enclosing FragmentArenaScope)
+template <typename T> class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator() : arena(&FragmentArena::forThread()) {};
+
+    template <typename U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {};
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); };
+
+    void deallocate(T *, size_t) {};
+
+    template <typename U> bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; };
+
+    template <typename U> bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; };
+
+    FragmentArena *arena;
+};
+
+template <typename T> using arena_vector = std::vector<T, ArenaAllocator<T>>;
+
+#endif // __FRAGMENT_ARENA_H__
@@ -0,0 +1,55 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentExpansionCache.cpp
+#
+# Description: 	Process-wide cache of the children generated for fragments,
+#				so fragments seen before are not broken again.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "FragmentExpansionCache.h"
+
+#include <algorithm>
+
+FragmentExpansionCache::shard_t FragmentExpansionCache::shards[FRAGMENT_EXPANSION_CACHE_NUM_SHARDS];
+std::atomic<long> FragmentExpansionCache::num_hits(0), FragmentExpansionCache::num_misses(0);
+
+std::shared_ptr<const fragment_expansion_t> FragmentExpansionCache::fetch(const std::string &key) {
+
+	shard_t &shard = shards[std::hash<std::string>()(key) % FRAGMENT_EXPANSION_CACHE_NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto it = shard.expansions.find(key);
+	if (it == shard.expansions.end()) {
+		num_misses++;
+		return nullptr;
+	}
+	num_hits++;
+	return it->second;
+}
+
+void FragmentExpansionCache::store(const std::string &key,
+                                   const std::shared_ptr<const fragment_expansion_t> &expansion,
+                                   size_t max_entries) {
+
+	size_t max_shard_entries = std::max<size_t>(1, max_entries / FRAGMENT_EXPANSION_CACHE_NUM_SHARDS);
+	shard_t &shard           = shards[std::hash<std::string>()(key) % FRAGMENT_EXPANSION_CACHE_NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (shard.expansions.size() >= max_shard_entries) shard.expansions.clear();
+	shard.expansions.emplace(key, expansion);
+}
+
+void FragmentExpansionCache::clear() {
+
+	for (auto &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.expansions.clear();
+	}
+}
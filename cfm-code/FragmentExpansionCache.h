@@ -0,0 +1,72 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentExpansionCache.h
+#
+# Description: 	Process-wide cache of the children generated for fragments,
+#				so fragments seen before are not broken again.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __FRAGMENT_EXPANSION_CACHE_H__
+#define __FRAGMENT_EXPANSION_CACHE_H__
+
+#include "FragmentTreeNode.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static const size_t FRAGMENT_EXPANSION_CACHE_NUM_SHARDS = 16;
+
+// The children generated for a fragment (with their own copies of the
+// molecules, and no thetas), whether each came from a ring break, and the
+// length of the fragment's fragmentation history
+struct fragment_expansion_t {
+    std::vector<FragmentTreeNode> children;
+    std::vector<bool> from_ring_break;
+    unsigned int history_size;
+};
+
+// Keyed by everything the children depend on (see FragmentTreeNode::getExpansionKey,
+// plus the generation settings), so a hit gives the children that breaking
+// the fragment again would, once given the fragment's own precursor labels and
+// history (see FragmentTreeNode::inheritLabels). The key follows the fragment's
+// atom numbering, so fragments shared between molecules hit when the molecules'
+// canonical numberings order them alike, as they do across homologues. Entries are never modified once
+// stored; callers copy the molecules before using them. A full shard is simply cleared.
+class FragmentExpansionCache {
+public:
+    static std::shared_ptr<const fragment_expansion_t> fetch(const std::string &key);
+
+    static void store(const std::string &key, const std::shared_ptr<const fragment_expansion_t> &expansion,
+                      size_t max_entries);
+
+    // Empty every shard (the hit and miss counts are kept)
+    static void clear();
+
+    static long getNumHits() { return num_hits.load(); };
+
+    static long getNumMisses() { return num_misses.load(); };
+
+private:
+    struct shard_t {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::shared_ptr<const fragment_expansion_t>> expansions;
+    };
+
+    static shard_t shards[FRAGMENT_EXPANSION_CACHE_NUM_SHARDS];
+    static std::atomic<long> num_hits, num_misses;
+};
+
+#endif // __FRAGMENT_EXPANSION_CACHE_H__
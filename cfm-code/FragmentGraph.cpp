@@ -16,6 +16,7 @@
 #########################################################################*/
 
 #include "FragmentGraph.h"
+#include "PredictionProfile.h"
 
 #include <GraphMol/AtomIterators.h>
 #include <GraphMol/BondIterators.h>
@@ -124,8 +125,8 @@ int FragmentGraph::addToGraphAndReplaceMolWithFV(const FragmentTreeNode &node, i
 		// Compute a feature vector
 		auto t = transitions.back();
 		FeatureVector *fv;
-		std::string frag_smiles = *fragments[parent_frag_id]->getIonSmiles();
-		auto frag_ptr           = createMolPtr(frag_smiles.c_str(), false);
+		romol_ptr_t frag_ptr;
+		if (fc->usesFragmentFeatures()) frag_ptr = getParsedIon(parent_frag_id);
 
 		try {
 			fv = fc->computeFeatureVector(t->getIon(), t->getNeutralLoss(), frag_ptr);
@@ -150,16 +151,45 @@ int FragmentGraph::addToGraphAndReplaceMolWithFV(const FragmentTreeNode &node, i
 		from_id_tmap[parent_frag_id].push_back(trans_idx);
 		to_id_tmap[frag_id].push_back(trans_idx);
 	}
+	addSymmetricDuplicateTransitions(node, parent_frag_id, frag_id);
 
 	return frag_id;
 }
 
+romol_ptr_t FragmentGraph::getParsedIon(int frag_id) {
+
+	auto it = parsed_ions.find(frag_id);
+	if (it != parsed_ions.end()) return it->second;
+	romol_ptr_t ion = createMolPtr(fragments[frag_id]->getIonSmiles()->c_str(), false);
+	parsed_ions[frag_id] = ion;
+	return ion;
+}
+
+void FragmentGraph::addSymmetricDuplicateTransitions(const FragmentTreeNode &node, int parent_frag_id,
+                                                     int frag_id) {
+
+	if (parent_frag_id < 0 || node.getMultiplicity() <= 1 || node.depth != fragments[frag_id]->getDepth()) return;
+	int existing_trans_id = findMatchingTransition(parent_frag_id, frag_id);
+	if (existing_trans_id < 0) return;
+
+	for (int i = 1; i < node.getMultiplicity(); i++) {
+		int trans_idx = transitions.size();
+		transitions.push_back(std::make_shared<Transition>());
+		auto trans = transitions.back();
+		trans->createdDuplication(*transitions[existing_trans_id]);
+		// Update the tmaps
+		from_id_tmap[parent_frag_id].push_back(trans_idx);
+		to_id_tmap[frag_id].push_back(trans_idx);
+	}
+}
+
 int FragmentGraph::addToGraphWithThetas(const FragmentTreeNode &node, const std::vector<double> *thetas,
-                                        int parent_frag_id) {
+                                        int parent_frag_id, const std::string *reduced_smiles) {
 
 	// If the fragment doesn't exist, add it
 	double mass = getMonoIsotopicMass(node.ion);
-	int frag_id = addFragmentOrFetchExistingId(node.ion, mass, node.isIntermediate(), node.isCyclization());
+	int frag_id =
+	    addFragmentOrFetchExistingId(node.ion, mass, node.isIntermediate(), node.isCyclization(), reduced_smiles);
 
 	if (parent_frag_id < 0 || fragments[frag_id]->getDepth() == -1)
 		fragments[frag_id]->setDepth(node.depth); // Set start fragment depth
@@ -194,50 +224,39 @@ int FragmentGraph::addToGraphWithThetas(const FragmentTreeNode &node, const std:
 		from_id_tmap[parent_frag_id].push_back(trans_idx);
 		to_id_tmap[frag_id].push_back(trans_idx);
 	}
+	addSymmetricDuplicateTransitions(node, parent_frag_id, frag_id);
 
 	return frag_id;
 }
 
 int FragmentGraph::addFragmentOrFetchExistingId(romol_ptr_t ion, double mass, bool is_intermediate,
-                                                bool is_cyclization) {
+                                                bool is_cyclization, const std::string *known_reduced_smiles) {
+
+	std::string reduced_smiles =
+	    known_reduced_smiles != nullptr ? *known_reduced_smiles : computeReducedSmiles(ion);
 
-	std::string reduced_smiles;
-	// Round the mass to 5 decimal places and use that as an initial filter
+	// Round the mass to 5 decimal places, and look for a fragment with that mass and the same
+	// canonical reduced smiles
 	double rounded_mass = floor(mass * 10000.0 + 0.5) / 10000.0;
-	if (frag_mass_lookup.find(rounded_mass) != frag_mass_lookup.end()) {
+	auto &smiles_lookup = frag_reduced_smiles_lookup[rounded_mass];
+	auto it             = smiles_lookup.find(reduced_smiles);
+	int existing_id     = it != smiles_lookup.end() ? it->second : -1;
 
-		// Create a copy of the ion and then reduce it, making all bonds single and filling in hydrogens
+	// Cross-check against substructure matching, and keep to its answer if they differ
+	if (verify_fragment_dedup) {
 		RDKit::RWMol f1_copy = *ion.get();
 		reduceMol(f1_copy);
-		// RDKit::MolOps::sanitizeMol(f1_copy);
-
-		// Found an entry with this mass, check the linked fragments for a match
-		std::vector<int>::iterator it;
-		it = frag_mass_lookup[rounded_mass].begin();
-		for (; it != frag_mass_lookup[rounded_mass].end(); ++it) {
-			try {
-				RDKit::RWMol *f2_reduced = RDKit::SmilesToMol(*fragments[*it]->getReducedSmiles(), 0, false);
-
-				if (areMatching(&f1_copy, f2_reduced)) {
-					delete f2_reduced;
-					return *it;
-				}
-				delete f2_reduced;
-			} catch (RDKit::MolSanitizeException &e) {
-				std::cout << "Could not sanitize " << *fragments[*it]->getReducedSmiles() << std::endl;
-				throw &e;
-			}
+		int matched_id = findMatchingFragment(f1_copy, rounded_mass);
+		if (matched_id != existing_id) {
+			std::cerr << "Warning: Fragment " << reduced_smiles << " identified as " << existing_id
+			          << " by canonical smiles, but as " << matched_id << " by substructure match" << std::endl;
+			num_dedup_mismatches++;
+			existing_id = matched_id;
 		}
-		reduced_smiles = RDKit::MolToSmiles(f1_copy);
-	} else
-		frag_mass_lookup[rounded_mass];
+	}
+	if (existing_id >= 0) return existing_id;
 
 	// No match found, create the fragment
-	if (reduced_smiles.size() == 0) {
-		RDKit::RWMol f1_copy = *ion.get();
-		reduceMol(f1_copy);
-		reduced_smiles = RDKit::MolToSmiles(f1_copy);
-	}
 	std::string smiles = RDKit::MolToSmiles(*ion.get());
 	int newid          = fragments.size();
 	if (include_isotopes) {
@@ -251,15 +270,59 @@ int FragmentGraph::addFragmentOrFetchExistingId(romol_ptr_t ion, double mass, bo
 	}
 
 	frag_mass_lookup[rounded_mass].push_back(newid);
+	smiles_lookup.emplace(reduced_smiles, newid);
 	from_id_tmap.resize(newid + 1);
 	to_id_tmap.resize(newid + 1);
 	return newid;
 }
 
+std::string FragmentGraph::computeReducedSmiles(romol_ptr_t ion) {
+
+	// Create a copy of the ion and then reduce it, making all bonds single and filling in hydrogens
+	RDKit::RWMol f1_copy = *ion.get();
+	reduceMol(f1_copy);
+	return RDKit::MolToSmiles(f1_copy);
+}
+
+int FragmentGraph::getExistingFragmentId(romol_ptr_t ion, const std::string &reduced_smiles) {
+
+	double mass         = getMonoIsotopicMass(ion);
+	double rounded_mass = floor(mass * 10000.0 + 0.5) / 10000.0;
+	auto mass_it        = frag_reduced_smiles_lookup.find(rounded_mass);
+	if (mass_it == frag_reduced_smiles_lookup.end()) return -1;
+
+	auto it = mass_it->second.find(reduced_smiles);
+	return it != mass_it->second.end() ? it->second : -1;
+}
+
+int FragmentGraph::findMatchingFragment(RDKit::RWMol &reduced_ion, double rounded_mass) {
+
+	auto mass_it = frag_mass_lookup.find(rounded_mass);
+	if (mass_it == frag_mass_lookup.end()) return -1;
+
+	// Found an entry with this mass, check the linked fragments for a match
+	for (int id : mass_it->second) {
+		try {
+			RDKit::RWMol *f2_reduced = RDKit::SmilesToMol(*fragments[id]->getReducedSmiles(), 0, false);
+
+			if (areMatching(&reduced_ion, f2_reduced)) {
+				delete f2_reduced;
+				return id;
+			}
+			delete f2_reduced;
+		} catch (RDKit::MolSanitizeException &e) {
+			std::cout << "Could not sanitize " << *fragments[id]->getReducedSmiles() << std::endl;
+			throw &e;
+		}
+	}
+	return -1;
+}
+
 bool FragmentGraph::areMatching(RDKit::ROMol *f1_reduced_ion, RDKit::ROMol *f2_reduced_ion) {
 
 	// Quick preliminary check to throw away non-matches
 	if (f1_reduced_ion->getNumAtoms() != f2_reduced_ion->getNumAtoms()) return false;
+	PredictionProfile::count(COUNT_DEDUP_MATCHES);
 
 	// Note: this will fail if one mol is a substruct
 	// of another but not an exact match, however given we've just
@@ -339,7 +402,7 @@ void FragmentGraph::writeFragmentsOnly(std::ostream &out) const {
 
 		if (it->isIntermediate()) out << " Intermediate Fragment";
 		if (it->isCyclization()) out << " Cyclization Fragment";
-		out << std::endl;
+		out << "\n";
 	}
 }
 
@@ -349,7 +412,7 @@ void FragmentGraph::writeFragmentsOnlyForIds(std::ostream &out, std::set<int> &i
 		if (ids.find(it->getId()) != ids.end()) {
 			out << it->getId() << " ";
 			out << std::setprecision(6) << it->getMass() << " ";
-			out << *(it->getIonSmiles()) << std::endl;
+			out << *(it->getIonSmiles()) << "\n";
 		}
 	}
 }
@@ -772,6 +835,7 @@ void FragmentGraph::getRandomSampledTransitions(std::set<int> &selected_trans_id
 
 void FragmentGraph::clearAllSmiles() {
 	for (auto &fragment : fragments) { fragment->clearSmiles(); }
+	frag_reduced_smiles_lookup.clear();
 };
 
 // Direct constructor that bipasses the mols altogether and directly sets the nl_smiles
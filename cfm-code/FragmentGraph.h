@@ -24,6 +24,7 @@
 #include <random>
 #include <queue>
 #include <set>
+#include <unordered_map>
 
 #include "Util.h"
 #include "Feature.h"
@@ -224,14 +225,20 @@ class FragmentGraph {
 public:
     FragmentGraph()
             : include_isotopes(false), allow_frag_detours(true),
-              include_h_losses(true), include_h_losses_precursor_only(false), allow_cyclization(false) {};
+              include_h_losses(true), include_h_losses_precursor_only(false), allow_cyclization(false),
+              verify_fragment_dedup(false), milp_solver(MILP_SOLVER_LP_SOLVE),
+              ring_perception(RING_PERCEPTION_SSSR), merge_symmetric_breaks(false) {};
 
     FragmentGraph(config_t *cfg)
             : include_isotopes(cfg->include_isotopes),
               allow_frag_detours(cfg->allow_frag_detours),
               include_h_losses(cfg->include_h_losses),
               include_h_losses_precursor_only(cfg->include_precursor_h_losses_only),
-              allow_cyclization(cfg->allow_cyclization) {
+              allow_cyclization(cfg->allow_cyclization),
+              verify_fragment_dedup(cfg->verify_fragment_dedup),
+              milp_solver(cfg->milp_solver),
+              ring_perception(cfg->ring_perception),
+              merge_symmetric_breaks(cfg->merge_symmetric_breaks) {
         if (include_isotopes)
             isotope = new IsotopeCalculator(cfg->isotope_thresh, cfg->isotope_pattern_file);
     };
@@ -258,9 +265,15 @@ public:
     // and store a feature vector instead
     int addToGraphAndReplaceMolWithFV(const FragmentTreeNode &node, int parent_frag_id, FeatureCalculator *fc);
 
+    // Drop the parent ion parsed for the transitions from this fragment (call once
+    // all of its children have been added)
+    void releaseParsedIon(int frag_id) { parsed_ions.erase(frag_id); };
+
     // As for previous function, but don't store the mols in the transition and
-    // insert the pre-computed thetas instead
-    int addToGraphWithThetas(const FragmentTreeNode &node, const std::vector<double> *thetas, int parent_frag_id);
+    // insert the pre-computed thetas instead. reduced_smiles, if given, is the
+    // node's from computeReducedSmiles (saving computing it again).
+    int addToGraphWithThetas(const FragmentTreeNode &node, const std::vector<double> *thetas, int parent_frag_id,
+                             const std::string *reduced_smiles = nullptr);
 
     // Write the Fragments only to file (formerly the backtrack output - without
     // extra details)
@@ -294,6 +307,24 @@ public:
     
     bool allowCyclization() const { return allow_cyclization; };
 
+    int getMILPSolver() const { return milp_solver; };
+
+    int getRingPerception() const { return ring_perception; };
+
+    bool mergesSymmetricBreaks() const { return merge_symmetric_breaks; };
+
+    // Number of fragments that the canonical smiles lookup and substructure
+    // matching identified differently (only counted when verifying)
+    int getNumDedupMismatches() const { return num_dedup_mismatches; };
+
+    // Canonical smiles of the ion reduced to its structure alone, which identifies
+    // its fragment
+    std::string computeReducedSmiles(romol_ptr_t ion);
+
+    // Id of the existing fragment with the same identity as the ion (given its
+    // reduced smiles), or -1 if there is none yet (doesn't modify the graph)
+    int getExistingFragmentId(romol_ptr_t ion, const std::string &reduced_smiles);
+
     void clearAllSmiles();
 
     // For current graph in use
@@ -370,14 +401,40 @@ protected:
     bool include_h_losses;
     bool include_h_losses_precursor_only;
     bool allow_cyclization;
+    bool verify_fragment_dedup;
+    int num_dedup_mismatches = 0;
+    int milp_solver;
+    int ring_perception;
+    bool merge_symmetric_breaks;
 
     // Mapping from rounded mass to list of fragment ids,
     // to enable fast check for existing fragments
     std::map<double, std::vector<int>> frag_mass_lookup;
 
+    // Mapping from rounded mass and canonical reduced smiles to fragment id,
+    // which identifies fragments without any substructure matching
+    std::map<double, std::unordered_map<std::string, int>> frag_reduced_smiles_lookup;
+
+    // Ions parsed from the smiles of fragments that are having children added,
+    // for computing the fragment features of each transition from them
+    std::unordered_map<int, romol_ptr_t> parsed_ions;
+
+    // The parsed ion for a fragment, parsing it on first use
+    romol_ptr_t getParsedIon(int frag_id);
+
     // Find the id for an existing fragment that matches the input ion and mass
     // or create a new fragment in the case where no such fragment is found
-    int addFragmentOrFetchExistingId(romol_ptr_t ion, double mass, bool is_intermediate, bool is_cyclization);
+    int addFragmentOrFetchExistingId(romol_ptr_t ion, double mass, bool is_intermediate, bool is_cyclization,
+                                     const std::string *reduced_smiles = nullptr);
+
+    // Add the duplicate transitions that the breaks symmetric to the one giving
+    // the node would have added (as adding the node again would)
+    void addSymmetricDuplicateTransitions(const FragmentTreeNode &node, int parent_frag_id, int frag_id);
+
+    // Find an existing fragment with this rounded mass whose reduced structure
+    // matches by substructure (the original identity check, used to verify the
+    // canonical smiles lookup) or -1 if there is none
+    int findMatchingFragment(RDKit::RWMol &reduced_ion, double rounded_mass);
 
     // Determine if the two fragments match - assumes the masses have already
     // been checked to be roughly the same, now check reduced structure.
@@ -17,6 +17,8 @@
 #########################################################################*/
 
 #include "FragmentGraphGenerator.h"
+#include "FragmentExpansionCache.h"
+#include "PredictionProfile.h"
 #include "Util.h"
 #include <GraphMol/AtomIterators.h>
 #include <GraphMol/BondIterators.h>
@@ -27,6 +29,15 @@
 #include <GraphMol/inchi.h>
 #include <GraphMol/new_canon.h>
 
+#include "omp.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <queue>
+#include <sstream>
+
 // Start a graph. Compute can then add to this graph, but it is the caller's
 // responsibility to delete it
 FragmentGraph *FragmentGraphGenerator::createNewGraph(config_t *cfg) {
@@ -41,36 +52,101 @@ FragmentGraph *LikelyFragmentGraphGenerator::createNewGraph(config_t *cfg) {
 	current_graph = new FragmentGraph(cfg);
 	id_prob_computed_cache.clear(); // The graph is empty, so clear all computation records
 	id_depth_computed_cache.clear();
+
+	// Worked out again for each graph, in case the weights have changed
+	max_unknown_thetas.clear();
+	if (cfg->prune_breaks_before_children && !is_nn_params) {
+		std::vector<std::pair<unsigned int, unsigned int>> ranges;
+		fc->getIdxRangesNeedingChild(ranges);
+		for (int energy = 0; energy < cfg->spectrum_depths.size(); energy++) {
+			double max_theta = 0.0;
+			for (auto &range : ranges) max_theta += param->computeMaxThetaOfRange(range.first, range.second, energy);
+			max_unknown_thetas.push_back(max_theta);
+		}
+	}
 	return current_graph;
 }
 
-// Create the starting node from a smiles or inchi string - responsibility of caller to delete
-FragmentTreeNode *FragmentGraphGenerator::createStartNode(std::string &smiles_or_inchi, int ionization_mode) {
+// Parse a smiles or inchi string - responsibility of caller to delete
+static RDKit::RWMol *parseSmilesOrInchi(const std::string &smiles_or_inchi) {
 
-	// Create the RDKit mol - this will be the ion
 	RDKit::RWMol *rwmol;
-
 	if (smiles_or_inchi.substr(0, 6) == "InChI=") {
 		RDKit::ExtraInchiReturnValues rv;
 		rwmol = RDKit::InchiToMol(smiles_or_inchi, rv);
 	} else
 		rwmol = RDKit::SmilesToMol(smiles_or_inchi);
 
-	// This is hacky way to get mol Canonicalized
-	rwmol = RDKit::SmilesToMol(RDKit::MolToSmiles(*rwmol));
-
-	// Canonical Rank Atoms
-	/*std::vector<unsigned int> atomRanks;
-	bool breakTies = true;
-	bool doIsomericSmiles = false;
-	RDKit::Canon::rankMolAtoms(*rwmol, atomRanks, doIsomericSmiles, doIsomericSmiles);*/
-
 	// This is dirty, but for some reason RDKit doesn't throw the exception...
 	if (!rwmol) throw RDKit::SmilesParseException("Error occurred - assuming Smiles Parse  Exception");
+	return rwmol;
+}
+
+// Canonical smiles for a smiles or inchi string, without stereochemistry
+std::string FragmentGraphGenerator::getCanonicalNonStereoSmiles(const std::string &smiles_or_inchi) {
 
-	// Remove stereochemistry
+	RDKit::RWMol *rwmol = parseSmilesOrInchi(smiles_or_inchi);
 	RDKit::MolOps::removeStereochemistry(*rwmol);
 
+	std::string canonical_smiles = RDKit::MolToSmiles(*rwmol);
+	delete rwmol;
+	return canonical_smiles;
+}
+
+// Parse a smiles or inchi string without stereochemistry, with its atoms and bonds in the order its canonical
+// smiles writes them, and their hydrogens held as parsing that smiles would hold them - responsibility of caller
+// to delete
+static RDKit::RWMol *parseInCanonicalOrder(const std::string &smiles_or_inchi) {
+
+	std::unique_ptr<RDKit::RWMol> input(parseSmilesOrInchi(smiles_or_inchi));
+	RDKit::MolOps::removeStereochemistry(*input);
+	RDKit::MolToSmiles(*input);
+	std::vector<unsigned int> atom_order, bond_order;
+	input->getProp(RDKit::common_properties::_smilesAtomOutputOrder, atom_order);
+	input->getProp(RDKit::common_properties::_smilesBondOutputOrder, bond_order);
+
+	std::unique_ptr<RDKit::RWMol> rwmol(new RDKit::RWMol());
+	std::vector<unsigned int> new_idx(input->getNumAtoms());
+	for (unsigned int i = 0; i < atom_order.size(); i++) {
+		new_idx[atom_order[i]] = i;
+		rwmol->addAtom(input->getAtomWithIdx(atom_order[i])->copy(), false, true);
+	}
+	for (auto bidx : bond_order) {
+		RDKit::Bond *bond  = input->getBondWithIdx(bidx)->copy();
+		unsigned int begin = new_idx[bond->getBeginAtomIdx()];
+		unsigned int end   = new_idx[bond->getEndAtomIdx()];
+		bond->setBeginAtomIdx(std::min(begin, end));
+		bond->setEndAtomIdx(std::max(begin, end));
+		rwmol->addBond(bond, true);
+	}
+
+	// Hydrogens the smiles leaves implicit are implicit, the rest explicit, however the input gave them
+	for (unsigned int i = 0; i < atom_order.size(); i++) {
+		RDKit::Atom *atom   = rwmol->getAtomWithIdx(i);
+		unsigned int num_hs = input->getAtomWithIdx(atom_order[i])->getTotalNumHs();
+		if (RDKit::SmilesWrite::inOrganicSubset(atom->getAtomicNum()) && atom->getFormalCharge() == 0 &&
+		    atom->getIsotope() == 0 && atom->getNumRadicalElectrons() == 0 && atom->getAtomMapNum() == 0) {
+			atom->setNoImplicit(false);
+			atom->setNumExplicitHs(0);
+			atom->updatePropertyCache(false);
+			if (atom->getTotalNumHs() == num_hs) continue;
+		}
+		atom->setNoImplicit(true);
+		atom->setNumExplicitHs(num_hs);
+	}
+	RDKit::MolOps::sanitizeMol(*rwmol);
+	return rwmol.release();
+}
+
+// Create the starting node from a smiles or inchi string - responsibility of caller to delete
+FragmentTreeNode *FragmentGraphGenerator::createStartNode(std::string &smiles_or_inchi, int ionization_mode) {
+
+	ProfileStageTimer timer(STAGE_CREATE_START_NODE);
+
+	// Create the RDKit mol - this will be the ion. Its atoms and bonds are in canonical order, so are
+	// the same for every input of the same structure
+	RDKit::RWMol *rwmol = parseInCanonicalOrder(smiles_or_inchi);
+
 	// Compute and label anything required by features that won't be present once the molecule breaks
 	fh->addLabels(rwmol);
 
@@ -83,8 +159,8 @@ FragmentTreeNode *FragmentGraphGenerator::createStartNode(std::string &smiles_or
 	std::vector<int> mapping;
 	int num_frags = RDKit::MolOps::getMolFrags(*rwmol, mapping);
 
-	// Initialize some properties of the molecule
-	RDKit::MolOps::findSSSR(*rwmol);
+	// Initialize some properties of the molecule (addLabels has already found the SSSR,
+	// and nothing since changes which bonds are in rings)
 	RDKit::RingInfo *rinfo = rwmol->getRingInfo();
 	RDKit::ROMol::AtomIterator ai;
 
@@ -144,6 +220,11 @@ int FragmentGraphGenerator::countExtraElectronPairs(RDKit::RWMol *rwmol, std::ve
 }
 
 // Helper function - check if the fragment has already been computed to at least this depth
+bool FragmentGraphGenerator::isComputed(int id, int remaining_depth) const {
+	auto it = id_depth_computed_cache.find(id);
+	return it != id_depth_computed_cache.end() && it->second >= remaining_depth;
+}
+
 bool FragmentGraphGenerator::alreadyComputed(int id, int remaining_depth) {
 	if (id_depth_computed_cache.find(id) == id_depth_computed_cache.end() // Not found
 	    || id_depth_computed_cache[id] < remaining_depth) {               // Or computed previously higher on the tree
@@ -187,19 +268,24 @@ void FragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth
 
 	if (current_graph->getHeight() < (node.depth + 1)) current_graph->setHeight(node.depth + 1);
 
+	// Scratch storage for this node (and, nested within it, its children), released
+	// on return. For the starting node this is all of the molecule's.
+	FragmentArenaScope arena_scope;
+
 	// Generate Breaks
-	std::vector<Break> breaks;
+	arena_vector<Break> breaks;
 	bool h_loss_allowed = false;
 	if (parent_id < 0) // Break from Precursor
 		h_loss_allowed = current_graph->includesHLossesPrecursorOnly() || current_graph->includesHLosses();
 	else // Break from Non-Precursor
 		h_loss_allowed = !(current_graph->includesHLossesPrecursorOnly()) && current_graph->includesHLosses();
-	node.generateBreaks(breaks, h_loss_allowed, current_graph->allowCyclization());
+	node.generateBreaks(breaks, h_loss_allowed, current_graph->allowCyclization(), current_graph->getRingPerception(),
+	                    current_graph->mergesSymmetricBreaks());
 	// Generate Child Node for this breaks
 	bool ring_can_break = (remaining_ring_breaks > 0);
 
-	std::vector<int> child_remaining_depth_vector;
-	std::vector<int> child_remaining_ring_breaks_vector;
+	arena_vector<int> child_remaining_depth_vector;
+	arena_vector<int> child_remaining_ring_breaks_vector;
 
 	for (auto &brk : breaks) {
 		if (brk.isRingBreak() && !ring_can_break) continue;
@@ -209,7 +295,7 @@ void FragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth
 
 			auto current_child_size = node.children.size();
 			node.applyBreak(brk, ifrag_idx);
-			node.generateChildrenOfBreak(brk);
+			node.generateChildrenOfBreak(brk, current_graph->getMILPSolver());
 			auto added_child_count          = node.children.size() - current_child_size;
 			// if this is ring break
 			// update control vars
@@ -220,14 +306,10 @@ void FragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth
 				child_remaining_depth++;
 				child_remaining_ring_breaks--;
 			}
-			std::vector<int> current_brk_child_depths(added_child_count, child_remaining_depth);
-			child_remaining_depth_vector.insert(child_remaining_depth_vector.end(), current_brk_child_depths.begin(),
-			                                    current_brk_child_depths.end());
-
-			std::vector<int> current_brk_child_remaining_rings(added_child_count, child_remaining_ring_breaks);
-			child_remaining_ring_breaks_vector.insert(child_remaining_ring_breaks_vector.end(),
-			                                          current_brk_child_remaining_rings.begin(),
-			                                          current_brk_child_remaining_rings.end());
+			child_remaining_depth_vector.insert(child_remaining_depth_vector.end(), added_child_count,
+			                                    child_remaining_depth);
+			child_remaining_ring_breaks_vector.insert(child_remaining_ring_breaks_vector.end(), added_child_count,
+			                                          child_remaining_ring_breaks);
 			node.undoBreak(brk, ifrag_idx);
 		}
 	}
@@ -235,6 +317,7 @@ void FragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth
 		compute(node.children[child_idx], child_remaining_depth_vector[child_idx], id,
 		        child_remaining_ring_breaks_vector[child_idx]);
 	}
+	if (mols_to_fv) current_graph->releaseParsedIon(id);
 	node.children = std::vector<FragmentTreeNode>();
 }
 
@@ -243,6 +326,32 @@ void FragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth
 void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining_depth, int parentid,
                                            double parent_log_prob, int remaining_ring_breaks) {
 
+	if (parentid < 0 && cfg->use_best_first_fg_gen) {
+		computeBestFirst(node, remaining_depth, parent_log_prob, remaining_ring_breaks);
+		return;
+	}
+
+	// Expanding children in parallel needs a team of threads to run the tasks: inside
+	// a parallel region (e.g. a batch of molecules) threads that run out of molecules
+	// pick them up, otherwise start a team for this molecule
+	if (parentid < 0 && cfg->parallel_fragment_expansion && !omp_in_parallel()) {
+		std::exception_ptr failure;
+#pragma omp parallel
+#pragma omp single
+		{
+			try {
+				computeNode(node, remaining_depth, parentid, parent_log_prob, remaining_ring_breaks, nullptr);
+			} catch (...) { failure = std::current_exception(); }
+		}
+		if (failure) std::rethrow_exception(failure);
+	} else
+		computeNode(node, remaining_depth, parentid, parent_log_prob, remaining_ring_breaks, nullptr);
+}
+
+void LikelyFragmentGraphGenerator::computeNode(FragmentTreeNode &node, int remaining_depth, int parentid,
+                                               double parent_log_prob, int remaining_ring_breaks,
+                                               node_expansion_t *expansion) {
+
 	// Check Timeout
 	if (parentid < 0) start_time = time(nullptr);
 	time_t current_time = time(nullptr);
@@ -252,7 +361,9 @@ void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining
 
 	// Add the node to the graph, and return a fragment id: note, no mols or fv will be set,
 	// but the precomputed theta value will be used instead
-	int id = current_graph->addToGraphWithThetas(node, node.getAllTmpThetas(), parentid);
+	const std::string *reduced_smiles =
+	    expansion != nullptr && !expansion->reduced_smiles.empty() ? &expansion->reduced_smiles : nullptr;
+	int id = current_graph->addToGraphWithThetas(node, node.getAllTmpThetas(), parentid, reduced_smiles);
 
 	// Reached max depth?
 	if (remaining_depth <= 0) return;
@@ -267,19 +378,234 @@ void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining
 	// Important height trick
 	if (current_graph->getHeight() < (node.depth + 1)) current_graph->setHeight(node.depth + 1);
 
-	// Generate Children
-	std::vector<Break> breaks;
+	// Generate Children (unless that was done in advance)
+	if (expansion != nullptr && expansion->failure) std::rethrow_exception(expansion->failure);
+	node_expansion_t own_expansion;
+	if (expansion == nullptr || !expansion->expanded) {
+		expandNode(node, parentid < 0, parent_log_prob, remaining_depth, remaining_ring_breaks, own_expansion);
+		expansion = &own_expansion;
+	}
+	std::vector<int> &children_remaining_depth       = expansion->children_remaining_depth;
+	std::vector<int> &children_remaining_ring_breaks = expansion->children_remaining_ring_breaks;
+
+	// The children and their thetas are all that is needed from here on, so the
+	// molecules can go (the start node's belong to the caller)
+	if (parentid >= 0) node.releaseMols();
+
+	// Find the likely children if above threshold for any energy level
+	std::vector<double> max_child_probs;
+	computeChildLogProbs(node, parent_log_prob, max_child_probs);
+	int child_idx;
+
+	// Unlikely children are never added to the graph, so only their thetas were needed
+	for (child_idx = 0; child_idx < node.children.size(); child_idx++) {
+		if (max_child_probs[child_idx] < log_prob_thresh) node.children[child_idx].releaseMols();
+	}
+
+	// Generate the children of the likely children as parallel tasks. The recursion
+	// below still visits them in order, so the graph is the same as computing them
+	// one at a time. Children that are certain to be skipped are left out.
+	std::vector<node_expansion_t> child_expansions(node.children.size());
+	if (cfg->parallel_fragment_expansion && omp_in_parallel()) {
+		PredictionProfile *profile = PredictionProfile::getActive();
+		for (child_idx = 0; child_idx < node.children.size(); child_idx++) {
+			if (max_child_probs[child_idx] < log_prob_thresh || children_remaining_depth[child_idx] <= 0) continue;
+			romol_ptr_t child_ion             = node.children[child_idx].ion;
+			std::string &child_reduced_smiles = child_expansions[child_idx].reduced_smiles;
+			child_reduced_smiles              = current_graph->computeReducedSmiles(child_ion);
+			int child_id = current_graph->getExistingFragmentId(child_ion, child_reduced_smiles);
+			if (child_id >= 0 && (isComputed(child_id, children_remaining_depth[child_idx]) ||
+			                      isComputedProb(child_id, max_child_probs[child_idx])))
+				continue;
+
+			FragmentTreeNode *child           = &node.children[child_idx];
+			node_expansion_t *child_expansion = &child_expansions[child_idx];
+			double child_log_prob             = max_child_probs[child_idx];
+			int child_remaining_depth         = children_remaining_depth[child_idx];
+			int child_remaining_ring_breaks   = children_remaining_ring_breaks[child_idx];
+#pragma omp task firstprivate(child, child_expansion, child_log_prob, child_remaining_depth, \
+                              child_remaining_ring_breaks, profile)
+			{
+				PredictionProfile *prev_profile = PredictionProfile::getActive();
+				PredictionProfile::setActive(profile);
+				try {
+					expandNode(*child, false, child_log_prob, child_remaining_depth, child_remaining_ring_breaks,
+					           *child_expansion);
+				} catch (...) {
+					child->children          = std::vector<FragmentTreeNode>();
+					child_expansion->failure = std::current_exception();
+				}
+				PredictionProfile::setActive(prev_profile);
+			}
+		}
+#pragma omp taskwait
+	}
+
+	// Add and recur over likely children
+	for (child_idx = 0; child_idx < node.children.size(); child_idx++) {
+		if (max_child_probs[child_idx] >= log_prob_thresh) {
+			computeNode(node.children[child_idx], children_remaining_depth[child_idx], id,
+			            max_child_probs[child_idx], children_remaining_ring_breaks[child_idx],
+			            &child_expansions[child_idx]);
+			// Don't keep a finished child's molecules (or children generated in
+			// advance, if it turned out to be computed already) until its siblings are done
+			node.children[child_idx].releaseMols();
+			node.children[child_idx].children = std::vector<FragmentTreeNode>();
+		}
+	}
+
+	// Clear the children
+	node.children = std::vector<FragmentTreeNode>();
+}
+
+// Compute a FragmentGraph from the most probable fragments down, until the graph is complete
+// or a budget runs out. The graph is then the most probable part of the full graph.
+void LikelyFragmentGraphGenerator::computeBestFirst(FragmentTreeNode &node, int remaining_depth,
+                                                    double parent_log_prob, int remaining_ring_breaks) {
+
+	auto start            = std::chrono::steady_clock::now();
+	unsigned int max_frag = cfg->best_first_max_fragments > 0 ? cfg->best_first_max_fragments
+	                                                          : MAX_FRAGMENTS_PER_MOLECULE;
+	unsigned int max_trans = cfg->best_first_max_transitions > 0 ? cfg->best_first_max_transitions
+	                                                             : MAX_TRANSITIONS_PER_MOLECULE;
+
+	std::priority_queue<queued_node_t> queue;
+	long num_queued = 0;
+	queue.push(queued_node_t{parent_log_prob, num_queued++, &node, -1, remaining_depth, remaining_ring_breaks});
+
+	try {
+		while (!queue.empty()) {
+			// Stop once any budget is used up, keeping what has been found
+			std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			if (current_graph->getNumFragments() >= max_frag || current_graph->getNumTransitions() >= max_trans ||
+			    (cfg->fragraph_compute_timeout_in_secs > 0 && elapsed.count() > cfg->fragraph_compute_timeout_in_secs))
+				break;
+
+			queued_node_t entry = queue.top();
+			queue.pop();
+			FragmentTreeNode &current = *entry.node;
+
+			int id = current_graph->addToGraphWithThetas(current, current.getAllTmpThetas(), entry.parentid);
+			if (entry.remaining_depth > 0 && !alreadyComputed(id, entry.remaining_depth) &&
+			    !alreadyComputedProb(id, entry.log_prob)) {
+
+				if (current_graph->getHeight() < (current.depth + 1)) current_graph->setHeight(current.depth + 1);
+
+				node_expansion_t expansion;
+				expandNode(current, entry.parentid < 0, entry.log_prob, entry.remaining_depth,
+				           entry.remaining_ring_breaks, expansion);
+				std::vector<double> max_child_probs;
+				if (entry.node != &node) current.releaseMols();
+				computeChildLogProbs(current, entry.log_prob, max_child_probs);
+				for (int child_idx = 0; child_idx < current.children.size(); child_idx++) {
+					if (max_child_probs[child_idx] < log_prob_thresh) continue;
+					queue.push(queued_node_t{max_child_probs[child_idx], num_queued++,
+					                         new FragmentTreeNode(std::move(current.children[child_idx])), id,
+					                         expansion.children_remaining_depth[child_idx],
+					                         expansion.children_remaining_ring_breaks[child_idx]});
+				}
+				current.children = std::vector<FragmentTreeNode>();
+			}
+			if (entry.node != &node) delete entry.node;
+		}
+	} catch (...) {
+		for (; !queue.empty(); queue.pop()) {
+			if (queue.top().node != &node) delete queue.top().node;
+		}
+		throw;
+	}
+	for (; !queue.empty(); queue.pop()) {
+		if (queue.top().node != &node) delete queue.top().node;
+	}
+}
+
+// The highest log probability over the energy levels of each child of the node
+void LikelyFragmentGraphGenerator::computeChildLogProbs(FragmentTreeNode &node, double parent_log_prob,
+                                                        std::vector<double> &max_child_probs) {
+
+	// Compute child probabilities (including persistence) - for all energy levels
+	std::vector<double> denom(cfg->spectrum_depths.size(), 0.0);
+
+	for (auto itt = node.children.begin(); itt != node.children.end(); ++itt) {
+		// (counting each child once for every symmetric break giving it)
+		double log_multiplicity = log((double)itt->getMultiplicity());
+		for (int energy = 0; energy < denom.size(); energy++) {
+			denom[energy] = logAdd(denom[energy], itt->getTmpTheta(energy) + log_multiplicity);
+			if (node.isIntermediate()) denom[energy] = logAdd(denom[energy], -100000000);
+		}
+	}
+
+	max_child_probs.resize(node.children.size());
+	int child_idx = 0;
+	for (auto itt = node.children.begin(); itt != node.children.end(); ++itt, child_idx++) {
+		double max_child_prob = log_prob_thresh - 10.0;
+		for (int energy = 0; energy < denom.size(); energy++) {
+			// normal prob + dups (last term)
+			double child_log_prob = itt->getTmpTheta(energy) - denom[energy] + parent_log_prob;
+			max_child_prob        = std::max(child_log_prob, max_child_prob);
+		}
+		max_child_probs[child_idx] = max_child_prob;
+	}
+}
+
+// Generate the children of a node, and their thetas
+void LikelyFragmentGraphGenerator::expandNode(FragmentTreeNode &node, bool is_precursor, double log_prob,
+                                              int remaining_depth, int remaining_ring_breaks,
+                                              node_expansion_t &expansion) {
+
 	bool h_loss_allowed = false;
-	if (parentid < 0) // Break from Precursor
+	if (is_precursor) // Break from Precursor
 		h_loss_allowed = current_graph->includesHLossesPrecursorOnly() || current_graph->includesHLosses();
 	else // Break from Non-Precursor
 		h_loss_allowed = !(current_graph->includesHLossesPrecursorOnly()) && current_graph->includesHLosses();
 
-	node.generateBreaks(breaks, h_loss_allowed, current_graph->allowCyclization());
-	std::vector<Break>::iterator it = breaks.begin();
+	std::vector<int> &children_remaining_ring_breaks = expansion.children_remaining_ring_breaks;
+	std::vector<int> &children_remaining_depth       = expansion.children_remaining_depth;
+
+	// Use the children from the cache if this fragment has been broken before (in any molecule)
+	std::string cache_key;
+	if (cfg->fragment_expansion_cache_size > 0 && node.getExpansionKey(cache_key)) {
+		std::ostringstream settings;
+		settings << h_loss_allowed << current_graph->allowCyclization() << (remaining_ring_breaks > 0)
+		         << current_graph->getMILPSolver() << current_graph->getRingPerception()
+		         << current_graph->mergesSymmetricBreaks();
+		for (unsigned int i = 0; i < NUM_FEATURE_HELPER_FLAGS; i++) settings << fh->getExecFlag(i);
+		settings << '|';
+		cache_key.insert(0, settings.str());
+
+		std::shared_ptr<const fragment_expansion_t> cached = FragmentExpansionCache::fetch(cache_key);
+		if (cached != nullptr) {
+			PredictionProfile::count(COUNT_EXPANSION_CACHE_HITS);
+			for (unsigned int i = 0; i < cached->children.size(); i++) {
+				node.children.push_back(cached->children[i].copyWithOwnMols(fh, node.depth + 1));
+				node.inheritLabels(node.children.back(), cached->history_size);
+				children_remaining_depth.push_back(remaining_depth - 1 + cached->from_ring_break[i]);
+				children_remaining_ring_breaks.push_back(remaining_ring_breaks - cached->from_ring_break[i]);
+			}
+			computeChildThetas(node);
+			expansion.expanded = true;
+			return;
+		}
+	}
+
+	// The breaks are done with before this returns, so they can be released with it
+	FragmentArenaScope arena_scope;
+	arena_vector<Break> breaks;
+	node.generateBreaks(breaks, h_loss_allowed, current_graph->allowCyclization(), current_graph->getRingPerception(),
+	                    current_graph->mergesSymmetricBreaks());
+	auto it = breaks.begin();
+
+	// The fragment features are the same for every child, so their part of the thetas is too
+	std::vector<double> fragment_thetas;
+	if (!max_unknown_thetas.empty()) {
+		FeatureVector *fragment_fv = fc->computeFragmentFeatureVector(node.ion);
+		for (int energy = 0; energy < max_unknown_thetas.size(); energy++)
+			fragment_thetas.push_back(param->computeTheta(*fragment_fv, energy));
+		delete fragment_fv;
+	}
+	bool pruned_breaks = false;
 
-	std::vector<int> children_remaining_ring_breaks;
-	std::vector<int> children_remaining_depth;
+	std::vector<bool> from_ring_break;
 	for (; it != breaks.end(); ++it) {
 		// Record the index where the children for this break start (if there are any)
 		//  if this is not
@@ -288,7 +614,13 @@ void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining
 		// Generate the children
 		for (int iidx = 0; iidx < it->getNumIonicFragAllocations(); iidx++) {
 			node.applyBreak(*it, iidx);
-			node.generateChildrenOfBreak(*it);
+			if (!max_unknown_thetas.empty() && isUnlikelyBreak(node, *it, fragment_thetas, log_prob)) {
+				PredictionProfile::count(COUNT_PRUNED_BREAKS);
+				pruned_breaks = true;
+				node.undoBreak(*it, iidx);
+				continue;
+			}
+			node.generateChildrenOfBreak(*it, current_graph->getMILPSolver());
 
 			// if this is ring break
 			// update control vars
@@ -302,12 +634,28 @@ void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining
 			while (children_remaining_ring_breaks.size() < node.children.size()) {
 				children_remaining_ring_breaks.push_back(child_remaining_ring_breaks);
 				children_remaining_depth.push_back(child_remaining_depth);
+				from_ring_break.push_back(it->isRingBreak());
 			}
 			node.undoBreak(*it, iidx);
 		}
 	}
 
-	// Compute child thetas
+	// (only complete sets of children are cached)
+	if (!cache_key.empty() && !pruned_breaks) {
+		auto to_cache = std::make_shared<fragment_expansion_t>();
+		for (auto &child : node.children) to_cache->children.push_back(child.copyWithOwnMols(nullptr, child.depth));
+		to_cache->from_ring_break = from_ring_break;
+		to_cache->history_size    = node.getHistorySize();
+		FragmentExpansionCache::store(cache_key, to_cache, cfg->fragment_expansion_cache_size);
+	}
+
+	computeChildThetas(node);
+	expansion.expanded = true;
+}
+
+// Compute the thetas of the children of a node
+void LikelyFragmentGraphGenerator::computeChildThetas(FragmentTreeNode &node) {
+
 	for (auto child = node.children.begin(); child != node.children.end(); ++child) {
 		Transition tmp_t(-1, -1, child->nl, child->ion);
 		FeatureVector *fv = fc->computeFeatureVector(tmp_t.getIon(), tmp_t.getNeutralLoss(), node.ion);
@@ -319,38 +667,40 @@ void LikelyFragmentGraphGenerator::compute(FragmentTreeNode &node, int remaining
 		}
 		delete fv;
 	}
+}
 
-	// Compute child probabilities (including persistence) - for all energy levels
-	std::vector<double> denom(cfg->spectrum_depths.size(), 0.0);
-
-	for (auto itt = node.children.begin(); itt != node.children.end(); ++itt) {
-		for (int energy = 0; energy < denom.size(); energy++) {
-			denom[energy] = logAdd(denom[energy], itt->getTmpTheta(energy));
-			if (node.isIntermediate()) denom[energy] = logAdd(denom[energy], -100000000);
-		}
-	}
-
-	// Add and recur over likely children if above threshold for any energy level
-	double max_child_prob;
-	int child_idx = 0;
+// A child's log probability is at most t - log(1 + m exp(t)) (plus the log probability
+// of the node), for its theta t and the multiplicity m of the break, as the denominator
+// holds at least the persistence and the child itself. That grows with t, so it is
+// bounded using the features computed from the break, plus the most the rest could add.
+// Either side of the break may end up as the ion, so both are checked.
+bool LikelyFragmentGraphGenerator::isUnlikelyBreak(FragmentTreeNode &node, Break &brk,
+                                                   const std::vector<double> &fragment_thetas, double log_prob) {
 
-	for (auto itt = node.children.begin(); itt != node.children.end(); ++itt, child_idx++) {
-		max_child_prob = log_prob_thresh - 10.0;
-		for (int energy = 0; energy < denom.size(); energy++) {
-			// normal prob + dups (last term)
-			double child_log_prob = itt->getTmpTheta(energy) - denom[energy] + parent_log_prob;
-			;
-			max_child_prob = std::max(child_log_prob, max_child_prob);
-		}
+	if (brk.isRingBreak() || brk.isIonicBreak() || brk.isHydrogenOnlyBreak() || brk.isCycliaztion() ||
+	    brk.getBondIdx() < 0)
+		return false;
 
-		if (max_child_prob >= log_prob_thresh) {
-			compute(*itt, children_remaining_depth[child_idx], id, max_child_prob,
-			        children_remaining_ring_breaks[child_idx]);
+	RDKit::Bond *bond       = node.ion->getBondWithIdx(brk.getBondIdx());
+	double log_multiplicity = log((double)brk.getMultiplicity());
+	for (int ion_side = 0; ion_side <= 1; ion_side++) {
+		bool begin_in_ion = node.getLabels().frag_idx[bond->getBeginAtomIdx()] == ion_side;
+		pending_child_t child;
+		child.parent          = node.ion;
+		child.broken_bond_idx = brk.getBondIdx();
+		child.ion_root        = begin_in_ion ? bond->getBeginAtom() : bond->getEndAtom();
+		child.nl_root         = begin_in_ion ? bond->getEndAtom() : bond->getBeginAtom();
+
+		FeatureVector *fv = fc->computeFeatureVectorFromBreak(child);
+		bool unlikely     = true;
+		for (int energy = 0; energy < max_unknown_thetas.size() && unlikely; energy++) {
+			double max_theta = param->computeTheta(*fv, energy) + fragment_thetas[energy] + max_unknown_thetas[energy];
+			unlikely         = max_theta - logAdd(0.0, max_theta + log_multiplicity) + log_prob < log_prob_thresh;
 		}
+		delete fv;
+		if (!unlikely) return false;
 	}
-
-	// Clear the children
-	node.children = std::vector<FragmentTreeNode>();
+	return true;
 }
 
 void FragmentGraphGenerator::applyIonization(RDKit::RWMol *rwmol, int ionization_mode) {
@@ -386,6 +736,11 @@ void FragmentGraphGenerator::applyIonization(RDKit::RWMol *rwmol, int ionization
 }
 
 // Helper function - check if the fragment has already been computed with at least this probability offset
+bool LikelyFragmentGraphGenerator::isComputedProb(int id, double prob_offset) const {
+	auto it = id_prob_computed_cache.find(id);
+	return it != id_prob_computed_cache.end() && it->second >= prob_offset;
+}
+
 int LikelyFragmentGraphGenerator::alreadyComputedProb(int id, double prob_offset) {
 	if (id_prob_computed_cache.find(id) == id_prob_computed_cache.end() ||
 	    id_prob_computed_cache[id] < prob_offset) { // Or computed previously with lower prob
@@ -394,3 +749,24 @@ int LikelyFragmentGraphGenerator::alreadyComputedProb(int id, double prob_offset
 	}
 	return 1;
 }
+
+LikelyFragmentGraphGeneratorPool::LikelyFragmentGraphGeneratorPool(Param *a_param, config_t *a_cfg,
+                                                                   double a_prob_thresh, int num_workers) {
+	// Created one after the other, so the static feature cogs are set up before any worker starts
+	for (int i = 0; i < num_workers; i++)
+		generators.push_back(new LikelyFragmentGraphGenerator(a_param, a_cfg, a_prob_thresh));
+}
+
+LikelyFragmentGraphGeneratorPool::LikelyFragmentGraphGeneratorPool(NNParam *a_param, config_t *a_cfg,
+                                                                   double a_prob_thresh, int num_workers) {
+	for (int i = 0; i < num_workers; i++)
+		generators.push_back(new LikelyFragmentGraphGenerator(a_param, a_cfg, a_prob_thresh));
+}
+
+LikelyFragmentGraphGeneratorPool::~LikelyFragmentGraphGeneratorPool() {
+	for (auto generator : generators) delete generator;
+}
+
+LikelyFragmentGraphGenerator &LikelyFragmentGraphGeneratorPool::getGenerator() {
+	return *generators[omp_get_thread_num() % generators.size()];
+}
@@ -24,6 +24,8 @@
 #include "NNParam.h"
 #include "Config.h"
 
+#include <exception>
+
 static const int MAX_FRAGMENTS_PER_MOLECULE = 100000;
 static const int MAX_TRANSITIONS_PER_MOLECULE = 1000000;
 
@@ -79,6 +81,11 @@ public:
     //Create the starting node from a smiles or inchi string - responsibility of caller to delete
     FragmentTreeNode *createStartNode(std::string &smiles_or_inchi, int ionization_mode);
 
+    //Canonical smiles for a smiles or inchi string, without stereochemistry, which the starting
+    //node doesn't keep. The starting node's atoms and bonds are in the order this writes them,
+    //so inputs with the same one give identical fragment graphs.
+    static std::string getCanonicalNonStereoSmiles(const std::string &smiles_or_inchi);
+
     //Compute a FragmentGraph starting at the given node and computing to the depth given.
     //The output will be appended to the current_graph
     // num_rbreak_nrbonds defualt to a huge number
@@ -97,6 +104,9 @@ protected:
     //Helper function - check if the fragment has already been computed to at least this depth
     bool alreadyComputed(int id, int remaining_depth);
 
+    //As above, but without recording the computation
+    bool isComputed(int id, int remaining_depth) const;
+
 private:
 
     //Static Helper functions
@@ -105,6 +115,32 @@ private:
     static void applyIonization(RDKit::RWMol *rwmol, int ionization_mode);
 };
 
+//Children generated for a node (with their thetas set), and the depth and
+//ring breaks remaining for each of them. The node's own reduced smiles are
+//kept too if they were found in advance, so adding it to the graph can use them.
+struct node_expansion_t {
+    bool expanded = false;
+    std::string reduced_smiles;
+    std::vector<int> children_remaining_depth;
+    std::vector<int> children_remaining_ring_breaks;
+    std::exception_ptr failure;
+};
+
+//A node waiting to be visited by the best-first search, ordered by probability
+//(and then by the order they were found in, so the search is deterministic)
+struct queued_node_t {
+    double log_prob;
+    long order;
+    FragmentTreeNode *node;
+    int parentid;
+    int remaining_depth;
+    int remaining_ring_breaks;
+
+    bool operator<(const queued_node_t &other) const {
+        return log_prob < other.log_prob || (log_prob == other.log_prob && order > other.order);
+    };
+};
+
 //Class to be used if a graph is to be pruned as it's created 
 //removing anything with probability below a given threshold
 class LikelyFragmentGraphGenerator : public FragmentGraphGenerator {
@@ -149,6 +185,63 @@ private:
     //Record of previous computations so we know to what probability each fragment has been computed at
     std::map<int, double> id_prob_computed_cache;
     int alreadyComputedProb(int id, double prob_offset);
+    bool isComputedProb(int id, double prob_offset) const;
+
+    //Compute from a node, using its children if they were generated in advance.
+    //With parallel_fragment_expansion, the children of a node's likely children
+    //are generated as tasks, and then visited in the same order as before.
+    void computeNode(FragmentTreeNode &node, int remaining_depth, int parentid, double parent_log_prob,
+                     int remaining_ring_breaks, node_expansion_t *expansion);
+
+    //Visit nodes most probable first (see use_best_first_fg_gen), stopping with a
+    //partial graph rather than an exception when a budget runs out
+    void computeBestFirst(FragmentTreeNode &node, int remaining_depth, double parent_log_prob,
+                          int remaining_ring_breaks);
+
+    void computeChildLogProbs(FragmentTreeNode &node, double parent_log_prob, std::vector<double> &max_child_probs);
+
+    //Generate the children of the node (at the given log probability), and their
+    //thetas. Only reads the graph, so several nodes can be expanded at once.
+    void expandNode(FragmentTreeNode &node, bool is_precursor, double log_prob, int remaining_depth,
+                    int remaining_ring_breaks, node_expansion_t &expansion);
+
+    void computeChildThetas(FragmentTreeNode &node);
+
+    //With prune_breaks_before_children (and a linear model): per energy, the most
+    //the features that can't be computed before a child is made can add to its theta
+    std::vector<double> max_unknown_thetas;
+
+    //Whether all the children of the applied break are certain to be below the
+    //probability threshold, judging by the features computable from the break
+    bool isUnlikelyBreak(FragmentTreeNode &node, Break &brk, const std::vector<double> &fragment_thetas,
+                         double log_prob);
+};
+
+//Pool of generators, one per worker thread. Each is created once and reused for
+//every molecule its worker handles (createNewGraph resets it between molecules),
+//so the FeatureCalculator and FeatureHelper are only set up once per worker.
+class LikelyFragmentGraphGeneratorPool {
+public:
+    //Constructors
+    LikelyFragmentGraphGeneratorPool(Param *a_param, config_t *a_cfg, double a_prob_thresh, int num_workers);
+
+    LikelyFragmentGraphGeneratorPool(NNParam *a_param, config_t *a_cfg, double a_prob_thresh, int num_workers);
+
+    LikelyFragmentGraphGeneratorPool(const LikelyFragmentGraphGeneratorPool &) = delete;
+
+    LikelyFragmentGraphGeneratorPool &operator=(const LikelyFragmentGraphGeneratorPool &) = delete;
+
+    ~LikelyFragmentGraphGeneratorPool();
+
+    int size() const { return generators.size(); };
+
+    LikelyFragmentGraphGenerator &getGenerator(int worker_idx) { return *generators[worker_idx]; };
+
+    //Generator belonging to the calling OpenMP thread
+    LikelyFragmentGraphGenerator &getGenerator();
+
+private:
+    std::vector<LikelyFragmentGraphGenerator *> generators;
 };
 
 #endif // __FRAG_GEN_H__
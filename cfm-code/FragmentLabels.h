@@ -0,0 +1,41 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# FragmentLabels.h
+#
+# Description: 	Dense per-atom and per-bond labels of an ion, used while
+#				its breaks are enumerated and its electrons allocated.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __FRAGMENT_LABELS_H__
+#define __FRAGMENT_LABELS_H__
+
+#include <vector>
+
+// The labels that applying a break and solving the MILP read and write for
+// every atom and bond, indexed by atom or bond index. While a node is being
+// broken these replace the FragIdx, Broken and NumUnbrokenRings properties
+// on its ion (which are only written to the copies the children are made
+// from), and hold the other labels so they aren't looked up by name.
+struct fragment_labels_t {
+    // Per atom
+    std::vector<int> frag_idx;
+    std::vector<int> orig_valence;
+    std::vector<int> ionic_fragment_charge;
+    std::vector<int> has_lp;
+    std::vector<unsigned int> atom_num_unbroken_rings;
+
+    // Per bond
+    std::vector<int> broken;
+    std::vector<unsigned int> bond_num_unbroken_rings;
+};
+
+#endif // __FRAGMENT_LABELS_H__
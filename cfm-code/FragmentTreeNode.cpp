@@ -19,6 +19,7 @@
 #include "FragmentTreeNode.h"
 #include "Config.h"
 #include "MILP.h"
+#include "PredictionProfile.h"
 #include "Util.h"
 
 #include <GraphMol/AtomIterators.h>
@@ -33,10 +34,18 @@
 #include <GraphMol/ChemTransforms/ChemTransforms.h>
 #include <GraphMol/ForceFieldHelpers/MMFF/AtomTyper.h>
 #include <GraphMol/PartialCharges/GasteigerCharges.h>
+#include <GraphMol/new_canon.h>
 
-void FragmentTreeNode::generateChildrenOfBreak(Break &brk) {
+#include <algorithm>
+#include <map>
+#include <set>
+#include <sstream>
 
-	bool verbose = false;
+void FragmentTreeNode::generateChildrenOfBreak(Break &brk, int milp_solver) {
+
+	ProfileStageTimer timer(STAGE_GENERATE_CHILDREN);
+	bool verbose             = false;
+	size_t num_prev_children = children.size();
 
 	int f0_max_e = 0, f1_max_e = 0, f0_max_out = 0, f1_max_out = 0;
 	std::vector<int> f0_output_bmax, f1_output_bmax;
@@ -56,13 +65,13 @@ void FragmentTreeNode::generateChildrenOfBreak(Break &brk) {
 
 	for (auto &rearrangement_config : rearrangement_configs) {
 		// Compute the max electron assignment for F0
-		MILP f0_solver(ion.get(), 0, brk_ringidx, verbose);
-		f0_max_e = f0_solver.runSolver(f0_output_bmax, true, f0_max_limit, rearrangement_config);
+		MILP f0_solver(ion.get(), labels, 0, brk_ringidx, verbose);
+		f0_max_e = f0_solver.runSolver(f0_output_bmax, true, f0_max_limit, rearrangement_config, milp_solver);
 
 		// Compute the max electron assignment for F1
 		if (brk.getBondIdx() != -1 && !brk.isRingBreak()) {
-			MILP f1_solver(ion.get(), 1, brk_ringidx, verbose);
-			f1_max_e = f1_solver.runSolver(f1_output_bmax, true, f1_max_limit, rearrangement_config);
+			MILP f1_solver(ion.get(), labels, 1, brk_ringidx, verbose);
+			f1_max_e = f1_solver.runSolver(f1_output_bmax, true, f1_max_limit, rearrangement_config, milp_solver);
 
 			unsigned int N = f0_output_bmax.size() - 2;
 			for (unsigned int i = 0; i < N; i++) f0_output_bmax[i] += f1_output_bmax[i];
@@ -91,11 +100,14 @@ void FragmentTreeNode::generateChildrenOfBreak(Break &brk) {
 			}
 		}
 	}
+
+	for (size_t i = num_prev_children; i < children.size(); i++) children[i].multiplicity = brk.getMultiplicity();
 }
 
 int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &output_bmax, Break &brk,
                                int charge_frag) {
 
+	FragmentArenaScope arena_scope;
 	RDKit::RWMol rwmol = *ion; // Copy the ion
 	int is_radical, is_negative;
 	ion->getProp("isRadical", is_radical);
@@ -103,24 +115,23 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 	int number_child_added = 0;
 
 	// Array to record the total connected bond orders for each atom
-	std::vector<int> ctd_bond_orders(rwmol.getNumAtoms(), 0);
+	arena_vector<int> ctd_bond_orders(rwmol.getNumAtoms(), 0);
 
 	// Set the correct bond orders on the fragments
-	int broken, fragidx;
+	int fragidx;
 	int numbonds       = (int)rwmol.getNumBonds();
 	int remaining_e[2] = {e_f0, e_to_allocate - e_f0};
 	int allocated_e[2] = {e_f0, e_to_allocate - e_f0};
-	std::vector<std::pair<int, int>> broken_specs;
+	arena_vector<std::pair<int, int>> broken_specs;
 	for (int i = 0; i < numbonds; i++) {
 		RDKit::Bond *bond = rwmol.getBondWithIdx(i);
-		bond->getProp("Broken", broken);
-		if (broken) {
+		if (labels.broken[i]) {
 			// Save the bond to remove at the end, removing it now causes problems with the iteration/indexing
 			broken_specs.emplace_back(bond->getBeginAtomIdx(), bond->getEndAtomIdx());
 			continue;
 		}
 		bond->setIsAromatic(false);
-		bond->getBeginAtom()->getProp("FragIdx", fragidx);
+		fragidx = labels.frag_idx[bond->getBeginAtomIdx()];
 
 		// std::cout <<  "[BOND]" <<  bond->getBeginAtomIdx() << " " <<
 		//           bond->getEndAtomIdx() << " [remaining_e] " << remaining_e[fragidx] << " output_bmax[i] " <<
@@ -142,7 +153,7 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 	if (remaining_e[0] > 0 || remaining_e[1] > 0) {
 		for (int i = 0; i < numbonds; i++) {
 			RDKit::Bond *bond = rwmol.getBondWithIdx(i);
-			bond->getBeginAtom()->getProp("FragIdx", fragidx);
+			fragidx           = labels.frag_idx[bond->getBeginAtomIdx()];
 			if (output_bmax[i + numbonds] > 0 && remaining_e[fragidx] > 0) {
 				bond->setBondType(RDKit::Bond::BondType(1 + (int)(bond->getBondTypeAsDouble())));
 				ctd_bond_orders[bond->getBeginAtomIdx()] += 1;
@@ -170,12 +181,11 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 		atom->setNumRadicalElectrons(0);
 		atom->setIsAromatic(false);
 
-		atom->getProp("OrigValence", orig_val);
-		atom->getProp("FragIdx", fragidx);
+		orig_val = labels.orig_valence[i];
+		fragidx  = labels.frag_idx[i];
 
 		// Ionic fragments must retain their charge and not attract hydrogens (for simplicity)
-		int ionic_frag_q;
-		atom->getProp("IonicFragmentCharge", ionic_frag_q);
+		int ionic_frag_q = labels.ionic_fragment_charge[i];
 
 		int nitro_group_charge;
 		atom->getProp("NitroGroupCharge", nitro_group_charge);
@@ -326,6 +336,7 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 			labelExtraBreakPropertiesInIon(child_ion, ion, brk);
 			auto child_node =
 			    FragmentTreeNode(child_ion, child_nl, allocated_e[charge_frag], depth + 1, fh, child_e_loc, true);
+			if (ring_perception != RING_PERCEPTION_SSSR) deriveChildRings(child_node);
 			children.push_back(child_node);
 			number_child_added++;
 		} else if (mols.size() == 2) {
@@ -348,6 +359,7 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 				labelExtraBreakPropertiesInIon(child_ion, ion, brk);
 				auto child_node =
 				    FragmentTreeNode(child_ion, child_nl, allocated_e[charge_frag], depth + 1, fh, child_e_loc, false);
+				if (ring_perception != RING_PERCEPTION_SSSR) deriveChildRings(child_node);
 				children.push_back(child_node);
 				number_child_added++;
 				/*
@@ -455,6 +467,7 @@ int FragmentTreeNode::addChild(int e_f0, int e_to_allocate, std::vector<int> &ou
 			labelExtraBreakPropertiesInIon(child_ion, ion, brk);
 			auto child_node =
 			    FragmentTreeNode(child_ion, child_nl, allocated_e[charge_frag], depth + 1, fh, child_e_loc, false);
+			if (ring_perception != RING_PERCEPTION_SSSR) deriveChildRings(child_node);
 			children.push_back(child_node);
 			number_child_added++;
 		}
@@ -881,29 +894,157 @@ void FragmentTreeNode::labelExtraBreakPropertiesInIon(romol_ptr_t &current_ion,
 	}
 }
 
-void FragmentTreeNode::generateBreaks(std::vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization) {
+// Labels left out of the expansion key: those that breaking overwrites before reading, those inherited from the
+// precursor that breaking never reads, and the fragmentation history. The last two are path or precursor
+// dependent, so are copied from the fragment being expanded onto children taken from the cache (see inheritLabels).
+static const std::set<std::string> labels_not_in_expansion_key{
+    "Root",         "OtherRoot",           "FragIdx",      "NumUnbrokenRings", "OrigIdx",
+    "MMFFAtomType", "OrigGasteigerCharge", "OriginalMass", "FunctionalGroups", "ExtraFunctionalGroups",
+    "FragmentationBondHistory"};
+
+// Write out the properties of an atom, bond or molecule that its children depend on
+static void writeProps(std::ostream &out, const RDKit::RDProps &obj) {
+	for (auto &name : obj.getPropList(false, false)) {
+		if (labels_not_in_expansion_key.count(name)) continue;
+		std::string value;
+		obj.getProp(name, value);
+		out << name << '=' << value << ';';
+	}
+}
+
+bool FragmentTreeNode::getExpansionKey(std::string &key) const {
+
+	std::ostringstream out;
+	out.precision(17);
+	out << ion_free_epairs << ' ' << is_intermediate << ' ' << is_cyclization << " e";
+	for (auto e : e_loc) out << ' ' << e;
+	if (has_derived_rings) {
+		for (auto &ring : derived_bond_rings) {
+			out << " r";
+			for (auto bidx : ring) out << ' ' << bidx;
+		}
+	}
+	try {
+		out << "|M";
+		writeProps(out, *ion);
+		for (unsigned int i = 0; i < ion->getNumAtoms(); i++) {
+			const RDKit::Atom *atom = ion->getAtomWithIdx(i);
+			out << "|A" << atom->getAtomicNum() << ',' << atom->getFormalCharge() << ',' << atom->getNumExplicitHs()
+			    << ',' << atom->getNoImplicit() << ',' << atom->getNumRadicalElectrons() << ','
+			    << atom->getIsotope() << ',' << atom->getIsAromatic() << ',' << atom->getChiralTag() << ',';
+			writeProps(out, *atom);
+		}
+		for (unsigned int i = 0; i < ion->getNumBonds(); i++) {
+			const RDKit::Bond *bond = ion->getBondWithIdx(i);
+			out << "|B" << bond->getBeginAtomIdx() << ',' << bond->getEndAtomIdx() << ',' << bond->getBondType()
+			    << ',' << bond->getIsAromatic() << ',' << bond->getStereo() << ',';
+			writeProps(out, *bond);
+		}
+	} catch (...) { return false; }
+	key = out.str();
+	return true;
+}
+
+unsigned int FragmentTreeNode::getHistorySize() const {
+
+	std::vector<int> history;
+	if (ion->hasProp("FragmentationBondHistory")) ion->getProp("FragmentationBondHistory", history);
+	return history.size();
+}
+
+template <typename T> static void copyLabel(const RDKit::RDProps &from, RDKit::RDProps &to, const std::string &name) {
+	if (from.hasProp(name)) to.setProp(name, from.getProp<T>(name));
+}
+
+void FragmentTreeNode::inheritLabels(FragmentTreeNode &child, unsigned int expanded_history_size) const {
+
+	// The child's history continues this node's, rather than that of the node it was cached for
+	std::string history_keyword = "FragmentationBondHistory";
+	if (child.ion->hasProp(history_keyword)) {
+		std::vector<int> history, child_history;
+		if (ion->hasProp(history_keyword)) ion->getProp(history_keyword, history);
+		child.ion->getProp(history_keyword, child_history);
+		if (child_history.size() >= expanded_history_size)
+			history.insert(history.end(), child_history.begin() + expanded_history_size, child_history.end());
+		child.ion->setProp(history_keyword, history);
+	}
+
+	// Cyclization children are labelled afresh, so already only depend on the key
+	if (child.is_cyclization) return;
+	for (auto &mol : {child.ion, child.nl}) {
+		if (!mol) continue;
+		for (auto ai = mol->beginAtoms(); ai != mol->endAtoms(); ++ai) {
+			unsigned int idx_in_parent;
+			(*ai)->getProp("OrigIdx", idx_in_parent);
+			if (idx_in_parent >= ion->getNumAtoms()) continue; // (e.g. the hydrogen of a hydrogen only loss)
+			const RDKit::Atom *parent_atom = ion->getAtomWithIdx(idx_in_parent);
+			copyLabel<int>(*parent_atom, **ai, "MMFFAtomType");
+			copyLabel<double>(*parent_atom, **ai, "OrigGasteigerCharge");
+			copyLabel<double>(*parent_atom, **ai, "OriginalMass");
+			copyLabel<std::vector<unsigned int>>(*parent_atom, **ai, "FunctionalGroups");
+			copyLabel<std::vector<unsigned int>>(*parent_atom, **ai, "ExtraFunctionalGroups");
+		}
+	}
+}
+
+FragmentTreeNode FragmentTreeNode::copyWithOwnMols(FeatureHelper *a_fh, int a_depth) const {
 
+	FragmentTreeNode copy = *this;
+	copy.ion              = romol_ptr_t(new RDKit::RWMol(*ion));
+	if (nl) copy.nl = romol_ptr_t(new RDKit::RWMol(*nl));
+	copy.fh    = a_fh;
+	copy.depth = a_depth;
+	return copy;
+}
+
+void FragmentTreeNode::releaseMols() {
+
+	ion.reset();
+	nl.reset();
+	labels = fragment_labels_t();
+	std::vector<int>().swap(e_loc);
+	has_derived_rings = false;
+	std::vector<std::vector<int>>().swap(derived_atom_rings);
+	std::vector<std::vector<int>>().swap(derived_bond_rings);
+}
+
+void FragmentTreeNode::generateBreaks(arena_vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization,
+                                      int ring_perception, bool merge_symmetric_breaks) {
+
+	ProfileStageTimer timer(STAGE_GENERATE_BREAKS);
 	int num_ionic            = countNumIonicFragments(ion.get());
 	RDKit::PeriodicTable *pt = RDKit::PeriodicTable::getTable();
 
 	// Populate the Ring Info for the ion and set the NumUnbrokenRings and OrigValence properties
-	RDKit::MolOps::findSSSR(*ion.get());
+	perceiveRings(ring_perception);
 	RDKit::RingInfo *rinfo = ion.get()->getRingInfo();
 	RDKit::ROMol::AtomIterator ai;
 	// std::cout << "[DEBUG][generateBreaks]" << RDKit::MolToSmiles( *ion.get() ) << std::endl;
 	labelNitroGroup(ion.get());
+	unsigned int num_atoms = ion.get()->getNumAtoms();
+	labels.frag_idx.assign(num_atoms, 0);
+	labels.orig_valence.resize(num_atoms);
+	labels.ionic_fragment_charge.resize(num_atoms);
+	labels.has_lp.resize(num_atoms);
+	labels.atom_num_unbroken_rings.resize(num_atoms);
 	for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms(); ++ai) {
-		(*ai)->setProp("NumUnbrokenRings", rinfo->numAtomRings((*ai)->getIdx()));
+		unsigned int aidx                     = (*ai)->getIdx();
+		labels.atom_num_unbroken_rings[aidx] = rinfo->numAtomRings(aidx);
+		(*ai)->setProp("NumUnbrokenRings", labels.atom_num_unbroken_rings[aidx]);
 
 		// Fetch or compute the valence of the atom in the input molecule (we disallow valence changes for now)
 		auto orig_val = getValence(*ai);
 		(*ai)->setProp("OrigValence", orig_val);
+		labels.orig_valence[aidx] = orig_val;
 		(*ai)->setProp("Root", 0);
 		(*ai)->setProp("OtherRoot", 0);
+		labels.has_lp[aidx] = 0;
+		if ((*ai)->hasProp("HasLP")) (*ai)->getProp("HasLP", labels.has_lp[aidx]);
 
 		// Create breaks for any implied ionic bonds (-1 bond_idx, and ring_idx overloaded with the atom idx)
 		int ionic_frag_q;
 		(*ai)->getProp("IonicFragmentCharge", ionic_frag_q);
+		labels.ionic_fragment_charge[aidx] = ionic_frag_q;
 		if (ionic_frag_q != 0 &&
 		    num_ionic != ion.get()->getNumAtoms()) //(must have at least one non-ionic atom to break further)
 			breaks.push_back(Break((*ai)->getIdx(), true, false, -1, computeNumIonicAlloc(num_ionic - 1), false));
@@ -919,12 +1060,13 @@ void FragmentTreeNode::generateBreaks(std::vector<Break> &breaks, bool include_H
 	//  how many bonds are attached to ring
 
 	int ring_bonds_count = 0;
+	labels.broken.assign(ion.get()->getNumBonds(), 0);
+	labels.bond_num_unbroken_rings.resize(ion.get()->getNumBonds());
 	for (unsigned int bidx = 0; bidx < ion.get()->getNumBonds(); bidx++) {
 
 		RDKit::Bond *bond = ion.get()->getBondWithIdx(bidx);
 
-		bond->setProp("Broken", 0);
-		bond->setProp("NumUnbrokenRings", rinfo->numBondRings(bidx));
+		labels.bond_num_unbroken_rings[bidx] = rinfo->numBondRings(bidx);
 
 		int was_on_the_ring = 0;
 		if (had_ring_break) {
@@ -972,13 +1114,72 @@ void FragmentTreeNode::generateBreaks(std::vector<Break> &breaks, bool include_H
 
 	// Hydrogen only breaks (-1 bond_idx, and -1 ring_idx)
 	if (include_H_only_loss) breaks.push_back(Break());
+
+	if (merge_symmetric_breaks) mergeSymmetricBreaks(breaks);
+}
+
+void FragmentTreeNode::generateBreaks(std::vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization,
+                                      int ring_perception, bool merge_symmetric_breaks) {
+
+	FragmentArenaScope arena_scope;
+	arena_vector<Break> arena_breaks;
+	generateBreaks(arena_breaks, include_H_only_loss, include_cyclization, ring_perception, merge_symmetric_breaks);
+	breaks.assign(arena_breaks.begin(), arena_breaks.end());
+}
+
+void FragmentTreeNode::mergeSymmetricBreaks(arena_vector<Break> &breaks) {
+
+	// Symmetry classes of the atoms (ranks with ties left unbroken), further split by
+	// anything else about the atoms that the children depend on
+	std::vector<unsigned int> ranks;
+	try {
+		RDKit::Canon::rankMolAtoms(*ion.get(), ranks, false);
+	} catch (...) { return; }
+	std::vector<std::string> atom_classes(ranks.size());
+	for (unsigned int i = 0; i < ranks.size(); i++) {
+		std::ostringstream out;
+		out << ranks[i] << ',' << e_loc[i] << ',' << labels.ionic_fragment_charge[i] << ',' << labels.has_lp[i] << ','
+		    << labels.orig_valence[i] << ',' << labels.atom_num_unbroken_rings[i];
+		atom_classes[i] = out.str();
+	}
+
+	// Breaks of the same kind, at bonds between the same atom classes (or at atoms of the same
+	// class) and with the same bond labels, give the same children
+	RDKit::RingInfo *rinfo = ion.get()->getRingInfo();
+	std::map<std::string, int> class_break_idxs;
+	arena_vector<Break> merged(breaks.get_allocator());
+	for (auto &brk : breaks) {
+		std::ostringstream out;
+		out << brk.isHydrogenOnlyBreak() << brk.isIonicBreak() << brk.isRingBreak() << brk.isCycliaztion() << ','
+		    << brk.getNumIonicFragAllocations() << '|';
+		if (brk.isIonicBreak())
+			out << atom_classes[brk.getIonicIdx()];
+		else if (!brk.isHydrogenOnlyBreak()) {
+			const RDKit::Bond *bond = ion.get()->getBondWithIdx(brk.getBondIdx());
+			std::string begin_class = atom_classes[bond->getBeginAtomIdx()];
+			std::string end_class   = atom_classes[bond->getEndAtomIdx()];
+			if (end_class < begin_class) std::swap(begin_class, end_class);
+			out << begin_class << '|' << end_class << '|' << bond->getBondType() << ',' << bond->getIsAromatic()
+			    << ',';
+			writeProps(out, *bond);
+			if (brk.isRingBreak()) out << '|' << rinfo->bondRings()[brk.getRingIdx()].size();
+		}
+
+		auto it = class_break_idxs.find(out.str());
+		if (it == class_break_idxs.end()) {
+			class_break_idxs[out.str()] = (int)merged.size();
+			merged.push_back(brk);
+		} else
+			merged[it->second].addSymmetricBreak();
+	}
+	breaks.swap(merged);
 }
 
 void FragmentTreeNode::applyBreak(Break &brk, int ionic_allocation_idx) {
 
 	// Initialise fragment idxs
 	RDKit::ROMol::AtomIterator ai;
-	for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms(); ++ai) (*ai)->setProp("FragIdx", 0);
+	std::fill(labels.frag_idx.begin(), labels.frag_idx.end(), 0);
 
 	// Label the broken bond, root atoms and fragment indexes
 	if (brk.isHydrogenOnlyBreak()) {
@@ -994,13 +1195,11 @@ void FragmentTreeNode::applyBreak(Break &brk, int ionic_allocation_idx) {
 		// Implied Ionic Break - No explicit bond to break, set root atoms
 		RDKit::Atom *ionic_atom = ion.get()->getAtomWithIdx(brk.getIonicIdx());
 		ionic_atom->setProp("Root", 1);
-		ionic_atom->setProp("FragIdx", 1);
-		int ionic_q;
-		ionic_atom->getProp("IonicFragmentCharge", ionic_q);
+		labels.frag_idx[brk.getIonicIdx()] = 1;
+		int ionic_q                        = labels.ionic_fragment_charge[brk.getIonicIdx()];
 		int root_idx = -1; // Pick a root atom on the other fragment
 		for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms(); ++ai) {
-			int a_ionic_q;
-			(*ai)->getProp("IonicFragmentCharge", a_ionic_q);
+			int a_ionic_q = labels.ionic_fragment_charge[(*ai)->getIdx()];
 			if (a_ionic_q != 0.0) continue; // Don't pick another ionic fragment
 			if ((*ai)->getFormalCharge() == -ionic_q) {
 				root_idx = (*ai)->getIdx();
@@ -1011,7 +1210,7 @@ void FragmentTreeNode::applyBreak(Break &brk, int ionic_allocation_idx) {
 		ion.get()->getAtomWithIdx(root_idx)->setProp("Root", 1);
 	} else { // Standard Bond Break or Ring Break
 		RDKit::Bond *broken_bond = ion.get()->getBondWithIdx(brk.getBondIdx());
-		broken_bond->setProp("Broken", 1);
+		labels.broken[brk.getBondIdx()] = 1;
 		broken_bond->getBeginAtom()->setProp("Root", 1);
 		broken_bond->getEndAtom()->setProp("Root", 1);
 
@@ -1031,14 +1230,16 @@ void FragmentTreeNode::applyBreak(Break &brk, int ionic_allocation_idx) {
 
 	// Assign fragment indexes for any (other) ionic fragments (which are otherwise always FragIdx=0)
 	int ionic_idx = ionic_allocation_idx;
-	for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms() && ionic_idx > 0; ++ai) {
-		int ionic_q;
-		(*ai)->getProp("IonicFragmentCharge", ionic_q);
-		if (ionic_q != 0 && (!brk.isIonicBreak() || (*ai)->getIdx() != brk.getIonicIdx())) {
-			if (ionic_idx & 0x1) (*ai)->setProp("FragIdx", 1);
+	for (unsigned int i = 0; i < labels.frag_idx.size() && ionic_idx > 0; i++) {
+		if (labels.ionic_fragment_charge[i] != 0 && (!brk.isIonicBreak() || i != brk.getIonicIdx())) {
+			if (ionic_idx & 0x1) labels.frag_idx[i] = 1;
 			ionic_idx = ionic_idx >> 1;
 		}
 	}
+
+	// The charge and radical placement works on copies of the ion, so needs the labels there
+	for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms(); ++ai)
+		(*ai)->setProp("FragIdx", labels.frag_idx[(*ai)->getIdx()]);
 }
 
 void FragmentTreeNode::undoBreak(Break &brk, int ionic_allocation_idx) {
@@ -1059,6 +1260,7 @@ void FragmentTreeNode::undoBreak(Break &brk, int ionic_allocation_idx) {
 		RDKit::Atom *ionic_atom = ion.get()->getAtomWithIdx(brk.getIonicIdx());
 		ionic_atom->setProp("Root", 0);
 		ionic_atom->setProp("FragIdx", 0);
+		labels.frag_idx[brk.getIonicIdx()] = 0;
 		int ionic_q = ionic_atom->getFormalCharge();
 
 		// Pick a root atom on the other fragment (ideally one of opposite charge to the ionic atom, else any)
@@ -1074,7 +1276,7 @@ void FragmentTreeNode::undoBreak(Break &brk, int ionic_allocation_idx) {
 		ion.get()->getAtomWithIdx(root_idx)->setProp("Root", 0);
 	} else {
 		RDKit::Bond *broken_bond = ion.get()->getBondWithIdx(brk.getBondIdx());
-		broken_bond->setProp("Broken", 0);
+		labels.broken[brk.getBondIdx()] = 0;
 		broken_bond->getBeginAtom()->setProp("Root", 0);
 		broken_bond->getEndAtom()->setProp("Root", 0);
 
@@ -1087,12 +1289,12 @@ void FragmentTreeNode::undoBreak(Break &brk, int ionic_allocation_idx) {
 
 	// Un-assign fragment indexes for any ionic fragments (which are otherwise always FragIdx=0)
 	int ionic_idx = ionic_allocation_idx;
-	RDKit::ROMol::AtomIterator ai;
-	for (ai = ion.get()->beginAtoms(); ai != ion.get()->endAtoms() && ionic_idx > 0; ++ai) {
-		int ionic_q;
-		(*ai)->getProp("IonicFragmentCharge", ionic_q);
-		if (ionic_q != 0 && (!brk.isIonicBreak() || (*ai)->getIdx() != brk.getIonicIdx())) {
-			if (ionic_idx & 0x1) (*ai)->setProp("FragIdx", 0);
+	for (unsigned int i = 0; i < labels.frag_idx.size() && ionic_idx > 0; i++) {
+		if (labels.ionic_fragment_charge[i] != 0 && (!brk.isIonicBreak() || i != brk.getIonicIdx())) {
+			if (ionic_idx & 0x1) {
+				labels.frag_idx[i] = 0;
+				ion.get()->getAtomWithIdx(i)->setProp("FragIdx", 0);
+			}
 			ionic_idx = ionic_idx >> 1;
 		}
 	}
@@ -1105,36 +1307,97 @@ void FragmentTreeNode::undoBreak(Break &brk, int ionic_allocation_idx) {
 
 		RDKit::RingInfo::VECT_INT_VECT arings = rinfo->atomRings();
 		for (it = arings[ringidx].begin(); it != arings[ringidx].end(); ++it) {
-			unsigned int numrings;
-			RDKit::Atom *atom = ion.get()->getAtomWithIdx(*it);
-			atom->getProp("NumUnbrokenRings", numrings);
-			atom->setProp("NumUnbrokenRings", numrings + 1);
+			labels.atom_num_unbroken_rings[*it]++;
+			ion.get()->getAtomWithIdx(*it)->setProp("NumUnbrokenRings", labels.atom_num_unbroken_rings[*it]);
 		}
 
 		RDKit::RingInfo::VECT_INT_VECT brings = rinfo->bondRings();
-		for (it = brings[ringidx].begin(); it != brings[ringidx].end(); ++it) {
-			unsigned int numrings;
-			RDKit::Bond *bond = ion.get()->getBondWithIdx(*it);
-			bond->getProp("NumUnbrokenRings", numrings);
-			bond->setProp("NumUnbrokenRings", numrings + 1);
+		for (it = brings[ringidx].begin(); it != brings[ringidx].end(); ++it) labels.bond_num_unbroken_rings[*it]++;
+	}
+}
+
+void FragmentTreeNode::perceiveRings(int a_ring_perception) {
+
+	ring_perception = a_ring_perception;
+	if (ring_perception == RING_PERCEPTION_SSSR || !has_derived_rings) {
+		RDKit::MolOps::findSSSR(*ion.get());
+		return;
+	}
+
+	// Check the derived rings are the same set as full perception finds (in any order)
+	if (ring_perception == RING_PERCEPTION_VERIFY) {
+		RDKit::MolOps::findSSSR(*ion.get());
+		std::set<std::vector<int>> perceived, derived;
+		for (auto ring : ion.get()->getRingInfo()->bondRings()) {
+			std::sort(ring.begin(), ring.end());
+			perceived.insert(ring);
+		}
+		for (auto ring : derived_bond_rings) {
+			std::sort(ring.begin(), ring.end());
+			derived.insert(ring);
+		}
+		if (perceived != derived) throw RingPerceptionMismatchException(RDKit::MolToSmiles(*ion.get()));
+	}
+
+	RDKit::RingInfo *rinfo = ion.get()->getRingInfo();
+	rinfo->reset();
+	rinfo->initialize();
+	for (unsigned int i = 0; i < derived_bond_rings.size(); i++)
+		rinfo->addRing(derived_atom_rings[i], derived_bond_rings[i]);
+}
+
+void FragmentTreeNode::deriveChildRings(FragmentTreeNode &child) const {
+
+	// Map the atoms of the parent to those of the child (if they are in it)
+	std::vector<int> child_idxs(ion.get()->getNumAtoms(), -1);
+	for (auto ai = child.ion.get()->beginAtoms(); ai != child.ion.get()->endAtoms(); ++ai) {
+		unsigned int idx_in_parent;
+		(*ai)->getProp("OrigIdx", idx_in_parent);
+		if (idx_in_parent < child_idxs.size()) child_idxs[idx_in_parent] = (*ai)->getIdx();
+	}
+
+	// Keep the rings with all their atoms in the child and none of their bonds broken
+	RDKit::RingInfo *rinfo                       = ion.get()->getRingInfo();
+	const RDKit::RingInfo::VECT_INT_VECT &arings = rinfo->atomRings();
+	const RDKit::RingInfo::VECT_INT_VECT &brings = rinfo->bondRings();
+	child.derived_atom_rings.clear();
+	child.derived_bond_rings.clear();
+	for (unsigned int ringidx = 0; ringidx < brings.size(); ringidx++) {
+		std::vector<int> atom_ring, bond_ring;
+		for (auto aidx : arings[ringidx]) {
+			if (child_idxs[aidx] < 0) break;
+			atom_ring.push_back(child_idxs[aidx]);
 		}
+		if (atom_ring.size() != arings[ringidx].size()) continue;
+		for (auto bidx : brings[ringidx]) {
+			const RDKit::Bond *bond = ion.get()->getBondWithIdx(bidx);
+			const RDKit::Bond *child_bond =
+			    labels.broken[bidx] ? nullptr
+			                        : child.ion.get()->getBondBetweenAtoms(child_idxs[bond->getBeginAtomIdx()],
+			                                                               child_idxs[bond->getEndAtomIdx()]);
+			if (child_bond == nullptr) break;
+			bond_ring.push_back(child_bond->getIdx());
+		}
+		if (bond_ring.size() != brings[ringidx].size()) continue;
+		child.derived_atom_rings.push_back(atom_ring);
+		child.derived_bond_rings.push_back(bond_ring);
 	}
+	child.has_derived_rings = true;
 }
 
 void FragmentTreeNode::allocatedCtdToFragment(RDKit::ROMol *romol, RDKit::Atom *atom) {
 
 	// set fragidx to 1 until we meet the broken bone
 	// this works if there is only two fragments since all fragidx already set to 1
-	int broken, fragidx;
-	atom->setProp("FragIdx", 1);
-
-	RDKit::ROMol::ADJ_ITER_PAIR itp = romol->getAtomNeighbors(atom);
-	for (; itp.first != itp.second; ++itp.first) {
-		RDKit::Atom *nbr_atom = romol->getAtomWithIdx(*itp.first);
-		nbr_atom->getProp("FragIdx", fragidx);
-		RDKit::Bond *bond = romol->getBondBetweenAtoms(atom->getIdx(), nbr_atom->getIdx());
-		bond->getProp("Broken", broken);
-		if (!fragidx && !broken) allocatedCtdToFragment(romol, nbr_atom);
+	labels.frag_idx[atom->getIdx()] = 1;
+
+	RDKit::ROMol::OEDGE_ITER beg, end;
+	boost::tie(beg, end) = romol->getAtomBonds(atom);
+	for (; beg != end; ++beg) {
+		const RDKit::Bond *bond = (*romol)[*beg];
+		RDKit::Atom *nbr_atom   = bond->getOtherAtom(atom);
+		if (!labels.frag_idx[nbr_atom->getIdx()] && !labels.broken[bond->getIdx()])
+			allocatedCtdToFragment(romol, nbr_atom);
 	}
 }
 
@@ -1164,15 +1427,11 @@ int FragmentTreeNode::computeNumIonicAlloc(int num_ionic_fragments) { return 1 <
 std::pair<int, int> FragmentTreeNode::computeOrigFreeElectronsPerFrag() {
 
 	std::pair<int, int> output(0, 0);
-	RDKit::ROMol::AtomIterator ait = ion.get()->beginAtoms();
-	for (; ait != ion.get()->endAtoms(); ++ait) {
-		int fragidx;
-		(*ait)->getProp("FragIdx", fragidx);
-		if (fragidx == 0)
-			output.first += e_loc[(*ait)->getIdx()];
+	for (unsigned int i = 0; i < labels.frag_idx.size(); i++) {
+		if (labels.frag_idx[i] == 0)
+			output.first += e_loc[i];
 		else
-			output.second += e_loc[(*ait)->getIdx()];
-		;
+			output.second += e_loc[i];
 	}
 	// fragment 0
 	output.first /= 2;
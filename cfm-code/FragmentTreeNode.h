@@ -18,9 +18,22 @@
 #ifndef __FRAG_TREE_NODE_H__
 #define __FRAG_TREE_NODE_H__
 
+#include "Config.h"
 #include "Util.h"
 #include "Feature.h"
 #include "Features/FeatureHelper.h"
+#include "FragmentArena.h"
+#include "FragmentLabels.h"
+
+#include <stdexcept>
+
+// Thrown when verifying ring perception. A runtime_error, so callers that
+// skip molecules on any other failure skip these too.
+class RingPerceptionMismatchException : public std::runtime_error {
+public:
+    RingPerceptionMismatchException(const std::string &smiles)
+            : std::runtime_error("Rings derived for " + smiles + " differ from those perceived in full.") {};
+};
 
 // Class for storing information about a particular break
 class Break {
@@ -29,14 +42,15 @@ public:
     Break()
             : h_only_break(true), ring_break(false), ionic_break(false), bond_idx(-1),
               ring_idx(-1), num_ionic_frag_allocations(1),
-              ionic_idx(-1), is_cycliaztion(false) {};
+              ionic_idx(-1), is_cycliaztion(false), multiplicity(1) {};
 
     // Constructor for Break (ionic or standard or ring)
     Break(int a_bond_or_ionic_atom_idx, bool a_ionic_break,
              bool is_ring_break, int a_ring_idx, int a_num_ionic_frag_allocations, bool is_cycliaztion)
             : h_only_break(false), ring_break(is_ring_break), ionic_break(a_ionic_break),
               bond_idx(-1), ring_idx(-1), ionic_idx(-1),
-              num_ionic_frag_allocations(a_num_ionic_frag_allocations), is_cycliaztion(is_cycliaztion) {
+              num_ionic_frag_allocations(a_num_ionic_frag_allocations), is_cycliaztion(is_cycliaztion),
+              multiplicity(1) {
 
         if (is_ring_break)
             ring_idx = a_ring_idx;
@@ -63,6 +77,11 @@ public:
 
     bool isCycliaztion() const { return is_cycliaztion; };
 
+    // Number of symmetric breaks this one stands for (itself included)
+    int getMultiplicity() const { return multiplicity; };
+
+    void addSymmetricBreak() { multiplicity++; };
+
 private:
     int bond_idx;    // Indexes of the broken bond(s)
 
@@ -75,6 +94,7 @@ private:
 
     bool h_only_break;
     bool is_cycliaztion;
+    int multiplicity;
 };
 
 // Class for generating fragments via the systematic bond disconnection approach
@@ -109,7 +129,14 @@ public:
     // num_rbreak_nrbonds is used to reduce mount of ring breaks
     // if a ion has less than give none ring break bonds, a ring break can happen
     // not the best idea ever
-    void generateBreaks(std::vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization);
+    // If merge_symmetric_breaks is set, breaks of symmetric bonds (or ionic atoms)
+    // are returned as one break recording how many it stands for
+    void generateBreaks(arena_vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization,
+                        int ring_perception = RING_PERCEPTION_SSSR, bool merge_symmetric_breaks = false);
+
+    // As above, into an ordinary vector (for callers not within a FragmentArenaScope)
+    void generateBreaks(std::vector<Break> &breaks, bool include_H_only_loss, bool include_cyclization,
+                        int ring_perception = RING_PERCEPTION_SSSR, bool merge_symmetric_breaks = false);
 
     // Record a break in the properties of the ion
     void applyBreak(Break &brk, int ionic_allocation_idx);
@@ -119,7 +146,7 @@ public:
 
     // For an already applied break, generate the possible child fragments
     // and add them to the children field in the node
-    void generateChildrenOfBreak(Break &brk);
+    void generateChildrenOfBreak(Break &brk, int milp_solver = MILP_SOLVER_LP_SOLVE);
 
     void setTmpTheta(double val, int energy) {
         if (tmp_thetas.size() < energy + 1)
@@ -159,7 +186,38 @@ public:
     undoAlreadyChargedOrSplitCharge(RDKit::RWMol &rwmol,
                                     boost::tuple<int, int, int> &pidx_nidx_ridx);
 
+    // Everything the children of this node depend on, apart from the generation
+    // settings: the ion (atoms, bonds and the properties breaking reads, in atom
+    // order), the free electron pairs and where the original electrons were.
+    // Returns false if some property can't be written out, so the node can't be
+    // cached.
+    bool getExpansionKey(std::string &key) const;
+
+    // Length of the fragmentation history of the ion
+    unsigned int getHistorySize() const;
+
+    // Give a child taken from the cache the labels left out of the expansion
+    // key: those inherited from this node's precursor, and the fragmentation
+    // history (continuing this node's, where the cached node's had the given size)
+    void inheritLabels(FragmentTreeNode &child, unsigned int expanded_history_size) const;
+
+    // Labels of the ion's atoms and bonds, as set by generateBreaks and the
+    // currently applied break
+    const fragment_labels_t &getLabels() const { return labels; };
+
+    // Copy with its own copies of the ion and neutral loss, at the given depth
+    FragmentTreeNode copyWithOwnMols(FeatureHelper *a_fh, int a_depth) const;
+
+    // Drop the ion, the neutral loss and the labels and rings kept for breaking
+    // the ion, once the node is in the graph and its children (if any) have been
+    // generated. The thetas, depth and flags are kept.
+    void releaseMols();
+
     bool isIntermediate() const { return is_intermediate; };
+
+    // Number of times the node is to be added to the graph as a child of its
+    // parent (once for each symmetric break giving it)
+    int getMultiplicity() const { return multiplicity; };
     
     bool isCyclization() const { return is_cyclization; };
 
@@ -176,12 +234,31 @@ private:
     // Temporary storage for the current theta value in each node
     std::vector<double> tmp_thetas;
 
+    fragment_labels_t labels;
+
+    // How the rings of the ion were found, and so how those of the children will be
+    int ring_perception = RING_PERCEPTION_SSSR;
+
+    // Rings of the ion carried over from the parent (the atom and bond indexes
+    // of each), when the parent derived them
+    bool has_derived_rings = false;
+    std::vector<std::vector<int>> derived_atom_rings, derived_bond_rings;
+
     // Helper functions:
     // Used to produce FragIdx labels for a broken molecule
     // assume all FragIdx set to 0 already
     // set atom's FragIdx to 1 recursively until we meet the broken bond
     void allocatedCtdToFragment(RDKit::ROMol *romol, RDKit::Atom *atom);
 
+    // Set the ring info of the ion, from the derived rings if there are any and
+    // the ring perception allows, and otherwise by full SSSR perception. When
+    // verifying, throws a RingPerceptionMismatchException if the two differ.
+    void perceiveRings(int a_ring_perception);
+
+    // Record the rings of the parent that are intact in the child (for the
+    // applied break), mapped to the child's atoms and bonds
+    void deriveChildRings(FragmentTreeNode &child) const;
+
     // Creates all the details and adds the children (with charge on either side)
     // of the node. -- e_f0 specifies the number of epairs to assigne to F0,
     // e_to_allocate is the total number to allocate, and output_bmax specifies
@@ -221,9 +298,13 @@ private:
 
     static void recordOrigAtomIdxs(RDKit::RWMol &rwmol);
 
+    // Keep one break for each set of symmetric breaks
+    void mergeSymmetricBreaks(arena_vector<Break> &breaks);
+
     // Flags
     bool is_intermediate = false;
     bool is_cyclization = false;
+    int multiplicity = 1;
 };
 
 #endif // __FRAG_TREE_NODE_H__
\ No newline at end of file
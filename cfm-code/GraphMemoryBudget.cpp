@@ -0,0 +1,135 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# GraphMemoryBudget.cpp
+#
+# Description: 	Admission control for computing fragment graphs, so that
+#				concurrent graphs stay within a memory budget.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "GraphMemoryBudget.h"
+#include "FragmentGraphGenerator.h"
+
+#include <algorithm>
+#include <cctype>
+
+void GraphMemoryBudget::acquire(size_t bytes) {
+
+	std::unique_lock<std::mutex> lock(budget_mutex);
+	if (budget_bytes == 0) {
+		reserved_bytes += bytes;
+		num_reservations++;
+		return;
+	}
+
+	if (bytes > budget_bytes) {
+		// Oversized - stop admitting anything else, and wait to run alone
+		budget_released.wait(lock, [this] { return !oversized_waiting; });
+		oversized_waiting = true;
+		budget_released.wait(lock, [this] { return num_reservations == 0; });
+		oversized_waiting = false;
+	} else {
+		budget_released.wait(
+		    lock, [this, bytes] { return !oversized_waiting && reserved_bytes + bytes <= budget_bytes; });
+	}
+	reserved_bytes += bytes;
+	num_reservations++;
+	lock.unlock();
+	budget_released.notify_all();
+}
+
+void GraphMemoryBudget::resize(size_t old_bytes, size_t new_bytes) {
+	{
+		std::lock_guard<std::mutex> lock(budget_mutex);
+		reserved_bytes = reserved_bytes - std::min(old_bytes, reserved_bytes) + new_bytes;
+	}
+	if (new_bytes < old_bytes) budget_released.notify_all();
+}
+
+void GraphMemoryBudget::release(size_t bytes) {
+	{
+		std::lock_guard<std::mutex> lock(budget_mutex);
+		reserved_bytes -= std::min(bytes, reserved_bytes);
+		num_reservations--;
+	}
+	budget_released.notify_all();
+}
+
+size_t GraphMemoryBudget::getReservedBytes() {
+	std::lock_guard<std::mutex> lock(budget_mutex);
+	return reserved_bytes;
+}
+
+size_t GraphMemoryBudget::estimateGraphBytes(const std::string &smiles_or_inchi) {
+
+	size_t num_atoms = countHeavyAtoms(smiles_or_inchi);
+	size_t max_bytes = MAX_FRAGMENTS_PER_MOLECULE * GRAPH_BYTES_PER_FRAGMENT +
+	                   MAX_TRANSITIONS_PER_MOLECULE * GRAPH_BYTES_PER_TRANSITION;
+	size_t estimate  = GRAPH_BYTES_PER_SQUARED_ATOM * num_atoms * num_atoms;
+	return std::max(GRAPH_MIN_ESTIMATED_BYTES, std::min(max_bytes, estimate));
+}
+
+size_t GraphMemoryBudget::measureGraphBytes(const FragmentGraph &fg) {
+
+	size_t bytes = 0;
+	for (unsigned int i = 0; i < fg.getNumFragments(); i++) {
+		const Fragment *fragment = fg.getFragmentAtIdx(i);
+		bytes += GRAPH_BYTES_PER_FRAGMENT + fragment->getIonSmiles()->capacity() +
+		         fragment->getReducedSmiles()->capacity();
+	}
+	for (unsigned int i = 0; i < fg.getNumTransitions(); i++) {
+		const TransitionPtr transition = fg.getTransitionAtIdx(i);
+		bytes += GRAPH_BYTES_PER_TRANSITION;
+		if (transition->getFeatureVector() != nullptr)
+			bytes += transition->getFeatureVector()->getNumSetFeatures() * sizeof(feature_t);
+		if (transition->getIon()->mol) bytes += GRAPH_BYTES_PER_TRANSITION_MOL;
+		if (transition->getNeutralLoss()->mol) bytes += GRAPH_BYTES_PER_TRANSITION_MOL;
+	}
+	return bytes;
+}
+
+int GraphMemoryBudget::countHeavyAtoms(const std::string &smiles_or_inchi) {
+
+	int num_atoms = 0;
+	if (smiles_or_inchi.compare(0, 6, "InChI=") == 0) {
+		// Sum the element counts in the formula layer (e.g. InChI=1S/C6H12O6/...), except hydrogen
+		std::string::size_type start = smiles_or_inchi.find('/');
+		std::string::size_type end   = smiles_or_inchi.find('/', start + 1);
+		if (start == std::string::npos) return 0;
+		std::string formula = smiles_or_inchi.substr(start + 1, end == std::string::npos ? end : end - start - 1);
+		for (size_t i = 0; i < formula.size();) {
+			if (!isupper(formula[i])) {
+				i++;
+				continue;
+			}
+			bool is_hydrogen = formula[i] == 'H' && (i + 1 == formula.size() || !islower(formula[i + 1]));
+			for (i++; i < formula.size() && islower(formula[i]); i++)
+				;
+			int count = 0;
+			for (; i < formula.size() && isdigit(formula[i]); i++) count = 10 * count + (formula[i] - '0');
+			if (!is_hydrogen) num_atoms += count > 0 ? count : 1;
+		}
+		return num_atoms;
+	}
+
+	// Count element symbols in the smiles: capitals (other than explicit H), and aromatic atoms
+	bool in_brackets = false;
+	for (size_t i = 0; i < smiles_or_inchi.size(); i++) {
+		char c = smiles_or_inchi[i];
+		if (c == '[' || c == ']')
+			in_brackets = c == '[';
+		else if (isupper(c) && c != 'H')
+			num_atoms++;
+		else if (c == 'c' || c == 'n' || c == 'o' || c == 's' || c == 'p')
+			num_atoms += !in_brackets || !isupper(smiles_or_inchi[i - 1]); // Not the 2nd letter of e.g. [Co]
+	}
+	return num_atoms;
+}
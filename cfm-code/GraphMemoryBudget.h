@@ -0,0 +1,110 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# GraphMemoryBudget.h
+#
+# Description: 	Admission control for computing fragment graphs, so that
+#				concurrent graphs stay within a memory budget.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __GRAPH_MEMORY_BUDGET_H__
+#define __GRAPH_MEMORY_BUDGET_H__
+
+#include "FragmentGraph.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+// Approximate heap use of graph elements (including their containers and
+// the strings, feature vectors, thetas and mols they usually hold)
+static const size_t GRAPH_BYTES_PER_FRAGMENT = 256;
+static const size_t GRAPH_BYTES_PER_TRANSITION = 512;
+static const size_t GRAPH_BYTES_PER_TRANSITION_MOL = 4096;
+
+// Estimated graph size per (heavy atom)^2, used before a graph is computed
+static const size_t GRAPH_BYTES_PER_SQUARED_ATOM = 64 * 1024;
+static const size_t GRAPH_MIN_ESTIMATED_BYTES = 1 << 20;
+
+// Tracks the memory reserved by the fragment graphs being computed, and holds
+// back the start of another graph while it wouldn't fit in the budget. Small
+// molecules fit alongside each other and start straight away; a molecule whose
+// estimate is larger than the whole budget waits until nothing else is
+// running, and while it waits no new molecules are admitted, so oversized
+// molecules run one at a time rather than being starved.
+class GraphMemoryBudget {
+public:
+    //Constructor - budget_bytes = 0 admits everything (but still tracks usage)
+    explicit GraphMemoryBudget(size_t a_budget_bytes) : budget_bytes(a_budget_bytes) {};
+
+    GraphMemoryBudget(const GraphMemoryBudget &) = delete;
+
+    GraphMemoryBudget &operator=(const GraphMemoryBudget &) = delete;
+
+    //Wait until bytes fit in the budget, then reserve them
+    void acquire(size_t bytes);
+
+    //Change an existing reservation (e.g. to the measured size) without waiting
+    void resize(size_t old_bytes, size_t new_bytes);
+
+    void release(size_t bytes);
+
+    size_t getReservedBytes();
+
+    size_t getBudgetBytes() const { return budget_bytes; };
+
+    //Estimate of the peak size of a graph, from the number of heavy atoms in the
+    //smiles or inchi (capped at the largest graph the generator will build)
+    static size_t estimateGraphBytes(const std::string &smiles_or_inchi);
+
+    //Size of a computed graph
+    static size_t measureGraphBytes(const FragmentGraph &fg);
+
+    static int countHeavyAtoms(const std::string &smiles_or_inchi);
+
+private:
+    size_t budget_bytes;
+    size_t reserved_bytes = 0;
+    int num_reservations = 0;
+    bool oversized_waiting = false;
+    std::mutex budget_mutex;
+    std::condition_variable budget_released;
+};
+
+// Scoped reservation in a budget (which may be nullptr, for no admission control)
+class GraphMemoryReservation {
+public:
+    GraphMemoryReservation(GraphMemoryBudget *a_budget, size_t a_bytes) : budget(a_budget), bytes(a_bytes) {
+        if (budget != nullptr) budget->acquire(bytes);
+    };
+
+    GraphMemoryReservation(const GraphMemoryReservation &) = delete;
+
+    GraphMemoryReservation &operator=(const GraphMemoryReservation &) = delete;
+
+    ~GraphMemoryReservation() { release(); };
+
+    void resize(size_t new_bytes) {
+        if (budget != nullptr) budget->resize(bytes, new_bytes);
+        bytes = new_bytes;
+    };
+
+    void release() {
+        if (budget != nullptr) budget->release(bytes);
+        budget = nullptr;
+    };
+
+private:
+    GraphMemoryBudget *budget;
+    size_t bytes;
+};
+
+#endif // __GRAPH_MEMORY_BUDGET_H__
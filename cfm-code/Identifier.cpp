@@ -16,6 +16,7 @@
 #########################################################################*/
 
 #include "Identifier.h"
+#include "PredictionDeduplicator.h"
 
 #include <GraphMol/SanitException.h>
 #include <GraphMol/SmilesParse/SmilesParse.h>
@@ -81,33 +82,57 @@ Identifier::rankCandidatesForSpecMatch(std::vector<Candidate> &candidates, const
         if(target_spectra->at(idx).size() > 0)
             used_engeries.push_back(idx);
 
+    //One generator (and FeatureCalculator/FeatureHelper) is reused for all candidates
+    LikelyFragmentGraphGenerator *fgen;
+    if (cfg->theta_function == NEURAL_NET_THETA_FUNCTION)
+        fgen = new LikelyFragmentGraphGenerator(nn_param, cfg, prob_thresh_for_prune);
+    else
+        fgen = new LikelyFragmentGraphGenerator(param, cfg, prob_thresh_for_prune);
+    Param &model = nn_param != nullptr ? *nn_param : *param;
+
+    //Candidates that only differ in stereochemistry share one prediction
+    PredictionDeduplicator *dedup = nullptr;
+    if (cfg->deduplicate_inputs)
+        dedup = new PredictionDeduplicator(candidates.size());
+
     //Compute the scores for each candidate
     auto it = candidates.begin();
     for (; it != candidates.end(); ++it) {
 
-        LikelyFragmentGraphGenerator *fgen;
         double score = 0.0;
         try {
 
             //Create the MolData structure with the input
             MolData moldata(it->getId()->c_str(), it->getSmilesOrInchi()->c_str(), cfg);
 
-            //Calculate the pruned FragmentGraph
-            if (cfg->theta_function == NEURAL_NET_THETA_FUNCTION)
-                fgen = new LikelyFragmentGraphGenerator(nn_param, cfg, prob_thresh_for_prune);
-            else
-                fgen = new LikelyFragmentGraphGenerator(param, cfg, prob_thresh_for_prune);
-            moldata.computeLikelyFragmentGraphAndSetThetas(*fgen, false);
-
-            //Predict the spectra (and post-process, use existing thetas)
-            for(auto & energy_level: used_engeries)
-                moldata.computePredictedSpectra(*param, true, energy_level,
-                                                cfg->default_predicted_peak_min,
-                                                cfg->default_predicted_peak_max,
-                                                cfg->default_postprocessing_energy,
-                                                cfg->default_predicted_min_intensity,
-                                                cfg->default_mz_decimal_place,
-                                                cfg->use_log_scale_peak);
+            PredictionDeduplicator::claim_t claim;
+            std::vector<Spectrum> shared_spectra;
+            if (dedup != nullptr)
+                claim = dedup->claimOrFetch(
+                        FragmentGraphGenerator::getCanonicalNonStereoSmiles(*it->getSmilesOrInchi()), shared_spectra);
+
+            if (dedup != nullptr && !claim)
+                moldata.setPredictedSpectra(shared_spectra);
+            else {
+                try {
+                    //Calculate the pruned FragmentGraph
+                    moldata.computeLikelyFragmentGraphAndSetThetas(*fgen, false);
+
+                    //Predict the spectra (and post-process, use existing thetas)
+                    for (auto &energy_level: used_engeries)
+                        moldata.computePredictedSpectra(model, true, energy_level,
+                                                        cfg->default_predicted_peak_min,
+                                                        cfg->default_predicted_peak_max,
+                                                        cfg->default_postprocessing_energy,
+                                                        cfg->default_predicted_min_intensity,
+                                                        cfg->default_mz_decimal_place,
+                                                        cfg->use_log_scale_peak);
+                } catch (...) {
+                    if (claim) claim->set_exception(std::current_exception());
+                    throw;
+                }
+                if (claim) claim->set_value(*moldata.getPredictedSpectra());
+            }
             
             if (output_all_scores)
                 std::cout << *it->getId() << ":";
@@ -166,8 +191,9 @@ Identifier::rankCandidatesForSpecMatch(std::vector<Candidate> &candidates, const
         }
 
         it->setScore(score);
-        delete fgen;
     }
+    delete fgen;
+    delete dedup;
     if (output_mode == MSP_OUTPUT_MODE || output_mode == MGF_OUTPUT_MODE) {
         of_spec.close();
         delete spec_out;
@@ -103,8 +103,8 @@ public:
 
 private:
 
-    Param *param;
-    NNParam *nn_param;
+    Param *param = nullptr;
+    NNParam *nn_param = nullptr;
     config_t *cfg;
     Comparator *cmp;
     double prob_thresh_for_prune;
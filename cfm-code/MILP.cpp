@@ -16,6 +16,8 @@
 #########################################################################*/
 
 #include "MILP.h"
+#include "ElectronPairSolver.h"
+#include "PredictionProfile.h"
 #include "lp_lib.h"
 #include <GraphMol/MolOps.h>
 #include <GraphMol/RWMol.h>
@@ -24,15 +26,46 @@
 // #ifndef __DEBUG_CONSTRAINTS__
 // #define __DEBUG_CONSTRAINTS__
 
-int MILP::runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free_pairs, bool allow_rearrangement) {
-	// Uses lp_solve: based on demonstration code provided.
-	unsigned int numunbroken;
-	int broken, fragidx, origval;
-	int Ncol, *colno = nullptr, i = 0, ret = 0, output_max_e = -1;
-	REAL *row = nullptr;
-	lprec *lp;
+MILPSolutionCache::shard_t MILPSolutionCache::shards[MILP_CACHE_NUM_SHARDS];
+std::atomic<long> MILPSolutionCache::num_hits(0), MILPSolutionCache::num_misses(0);
+std::atomic<bool> MILPSolutionCache::enabled(true);
+
+bool MILPSolutionCache::fetch(const std::string &key, milp_solution_t &solution) {
+
+	if (!enabled) return false;
+	shard_t &shard = shards[std::hash<std::string>()(key) % MILP_CACHE_NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	auto it = shard.solutions.find(key);
+	if (it == shard.solutions.end()) {
+		num_misses++;
+		return false;
+	}
+	solution = it->second;
+	num_hits++;
+	return true;
+}
+
+void MILPSolutionCache::store(const std::string &key, const milp_solution_t &solution) {
+
+	if (!enabled) return;
+	shard_t &shard = shards[std::hash<std::string>()(key) % MILP_CACHE_NUM_SHARDS];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	if (shard.solutions.size() >= MILP_CACHE_MAX_ENTRIES_PER_SHARD) shard.solutions.clear();
+	shard.solutions.emplace(key, solution);
+}
 
-	// use
+void MILPSolutionCache::clear() {
+
+	for (auto &shard : shards) {
+		std::lock_guard<std::mutex> lock(shard.mutex);
+		shard.solutions.clear();
+	}
+}
+
+int MILP::runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free_pairs, bool allow_rearrangement,
+                    int solver) {
+	ProfileStageTimer timer(STAGE_MILP_SOLVE);
+	PredictionProfile::count(COUNT_MILP_SOLVES);
 
 	auto kekulized_mol = RDKit::RWMol(*mol);
 	RDKit::MolOps::Kekulize(kekulized_mol);
@@ -44,223 +77,225 @@ int MILP::runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free
 	// place for charge due to H loss per atom (at most one total)
 	int num_bonds = (int)kekulized_mol.getNumBonds();
 	int num_atoms = (int)kekulized_mol.getNumAtoms();
-	Ncol          = num_bonds * 3 + num_atoms;
-	lp            = make_lp(0, Ncol);
-	if (lp == nullptr) ret = 1; /* couldn't construct a new model... */
+	int Ncol      = num_bonds * 3 + num_atoms;
+
+	constraints.clear();
+	int min_single_bonds =
+	    buildModel(kekulized_mol, constraints, allow_lp_q, max_free_pairs, allow_rearrangement);
+
+	// Solve the model, unless exactly the same model has been solved before
+	// (the solvers may settle on different optimal allocations, so they are kept apart)
+	solution        = milp_solution_t();
+	solver_used     = solver;
+	std::string key = encodeModel(Ncol, constraints);
+	key.push_back((char)solver);
+	if (MILPSolutionCache::fetch(key, solution))
+		PredictionProfile::count(COUNT_MILP_CACHE_HITS);
+	else {
+		bool solved = false;
+		if (solver == MILP_SOLVER_COMBINATORIAL) {
+			ElectronPairSolver epsolver(Ncol, constraints);
+			solved = epsolver.solve(solution);
+			if (!solved) {
+				PredictionProfile::count(COUNT_MILP_FALLBACKS);
+				solver_used = MILP_SOLVER_LP_SOLVE;
+			}
+		}
+		if (!solved) solveModel(Ncol, constraints, solution);
+		MILPSolutionCache::store(key, solution);
+	}
 
-	if (ret == 0) {
-		colno = (int *)malloc(Ncol * sizeof(*colno));
-		row   = (REAL *)malloc(Ncol * sizeof(*row));
-		if ((colno == nullptr) || (row == nullptr)) ret = 2;
+	// Extract Results
+	int output_max_e = -1;
+	output_bmax.resize(Ncol);
+	if (solution.optimal) {
+		for (int j = 0; j < Ncol; j++) output_bmax[j] = solution.values[j];
+		output_max_e = solution.objective - min_single_bonds;
+	} else {
+		for (int j = 0; j < Ncol; j++) output_bmax[j] = 0;
 	}
 
+	// Combine the lone pair results
+	for (int j = 0; j < num_bonds; j++) output_bmax[j + num_bonds] += output_bmax[j + 2 * num_bonds];
+	// Condense the atom H loss charge position results to a single index (or -1 if none)
+	int hloss_idx[2] = {-1, -1};
+	for (int j = 0; j < num_atoms; j++) {
+		if (output_bmax[j + 3 * num_bonds]) hloss_idx[fragmentidx] = j;
+	}
+	output_bmax.resize(2 * num_bonds + 2);
+	output_bmax[2 * num_bonds]     = hloss_idx[0];
+	output_bmax[2 * num_bonds + 1] = hloss_idx[1];
+
+	return output_max_e;
+}
+
+int MILP::buildModel(RDKit::RWMol &kekulized_mol, std::vector<milp_constraint_t> &constraints, bool allow_lp_q,
+                     int max_free_pairs, bool allow_rearrangement) {
+
+	int fragidx, origval, i;
+	int num_bonds = (int)kekulized_mol.getNumBonds();
+	int num_atoms = (int)kekulized_mol.getNumAtoms();
+	int Ncol      = num_bonds * 3 + num_atoms;
+
 	// Bond Constraints
 	int min_single_bonds = 0;
-	if (ret == 0) {
-		set_add_rowmode(lp, TRUE);
-
-		// All bonds must be at most TRIPLE bonds ( <= 3 )
-		// except broken bonds ( <= 0 ) and ring bonds ( <= 2 )
-		for (i = 0; i < num_bonds && ret == 0; i++) {
-			// set_int(lp, i + 1, TRUE); //sets variable to integer
-
-			RDKit::Bond *bond = kekulized_mol.getBondWithIdx(i);
-			int limit         = 0;                    // bonds that are broken or in the other fragment are limited to 0
-			int end_lp_limit = 0, begin_lp_limit = 0; // bonds for which there is no lone pair to donate (or broken, or
-			                                          // in other fragment) are limited to 0
-			bond->getProp("Broken", broken);
-			RDKit::Atom *begin_atom = bond->getBeginAtom();
-			begin_atom->getProp("FragIdx", fragidx);
-			int min_limit = 0;
-			if (!broken && fragidx == fragmentidx) {
-
-				if (!allow_rearrangement) {
-					min_limit = int(bond->getBondTypeAsDouble());
-					limit     = std::max(min_limit, 2);
-				} else {
-					min_limit = 1;
-					limit     = 3;
-				}
-
-				min_single_bonds++;
-				bond->getProp("NumUnbrokenRings", numunbroken);
-				if (numunbroken > 0)
-					limit = 2;
-				else {
-					begin_lp_limit = allow_lp_q && getAtomLPLimit(begin_atom);
-					end_lp_limit   = allow_lp_q && getAtomLPLimit(bond->getEndAtom());
-				}
-			}
-			// Valence limit constraint
-			colno[0] = i + 1;                 // variable idx i.e. bond
-			row[0]   = 1;                     // multiplier
-			colno[1] = num_bonds + i + 1;     // variable idx i.e. begin lone pair bond
-			row[1]   = 1;                     // multiplier
-			colno[2] = 2 * num_bonds + i + 1; // variable idx i.e. end lone pair bond
-			row[2]   = 1;                     // multiplier
-
-			if (!add_constraintex(lp, 3, row, colno, LE, limit)) {
-				ret = 3;
-				break;
-			}
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(3, colno, false, limit);
-#endif
 
-			// Minimum constraint (LP bond + standard bond is at least a single bond)
-			colno[0] = i + 1;
-			row[0]   = 1; // multiplier
-			if (!add_constraintex(lp, 1, row, colno, GE, min_limit)) {
-				ret = 3;
-				break;
-			}
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(1, colno, true, min_limit);
-#endif
-			// Lone pair constraint due to begin atom
-			colno[0] = num_bonds + i + 1;
-			row[0]   = 1; // multiplier
-			if (!add_constraintex(lp, 1, row, colno, LE, begin_lp_limit)) {
-				ret = 3;
-				break;
+	// All bonds must be at most TRIPLE bonds ( <= 3 )
+	// except broken bonds ( <= 0 ) and ring bonds ( <= 2 )
+	for (i = 0; i < num_bonds; i++) {
+		RDKit::Bond *bond = kekulized_mol.getBondWithIdx(i);
+		int limit         = 0;                    // bonds that are broken or in the other fragment are limited to 0
+		int end_lp_limit = 0, begin_lp_limit = 0; // bonds for which there is no lone pair to donate (or broken, or
+		                                          // in other fragment) are limited to 0
+		RDKit::Atom *begin_atom = bond->getBeginAtom();
+		fragidx                 = labels.frag_idx[begin_atom->getIdx()];
+		int min_limit = 0;
+		if (!labels.broken[i] && fragidx == fragmentidx) {
+
+			if (!allow_rearrangement) {
+				min_limit = int(bond->getBondTypeAsDouble());
+				limit     = std::max(min_limit, 2);
+			} else {
+				min_limit = 1;
+				limit     = 3;
 			}
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(1, colno, false, begin_lp_limit);
-#endif
 
-			// Lone pair constraint due to end atom
-			colno[0] = 2 * num_bonds + i + 1;
-			row[0]   = 1; // multiplier
-			if (!add_constraintex(lp, 1, row, colno, LE, end_lp_limit)) {
-				ret = 3;
-				break;
+			min_single_bonds++;
+			if (labels.bond_num_unbroken_rings[i] > 0)
+				limit = 2;
+			else {
+				begin_lp_limit = allow_lp_q && getAtomLPLimit(begin_atom);
+				end_lp_limit   = allow_lp_q && getAtomLPLimit(bond->getEndAtom());
 			}
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(1, colno, false, end_lp_limit);
-#endif
 		}
+		// Valence limit constraint: bond + begin lone pair bond + end lone pair bond
+		addConstraint(constraints, false, limit, {i + 1, num_bonds + i + 1, 2 * num_bonds + i + 1});
 
-		// Add constraints for neighbouring ring bonds (can't have two double in a row)
-		RDKit::RingInfo *rinfo                       = kekulized_mol.getRingInfo();
-		RDKit::RingInfo::VECT_INT_VECT brings        = rinfo->bondRings();
-		RDKit::RingInfo::VECT_INT_VECT::iterator bit = brings.begin();
-		for (int ringidx = 0; bit != brings.end() && ret == 0; ++bit, ringidx++) {
-
-			if (ringidx == broken_ringidx) continue;
-			row[0] = 1;
-			row[1] = 1;
-			row[2] = 1;
-			row[3] = 1;
-
-			// Create a vector of flags indicating bonds included in the ring
-			std::vector<int> ring_bond_flags(num_bonds);
-			for (int k = 0; k < num_bonds; k++) ring_bond_flags[k] = 0;
-			RDKit::RingInfo::INT_VECT::iterator it;
-			for (it = bit->begin(); it != bit->end(); ++it) ring_bond_flags[*it] = 1;
-
-			// Traverse around the ring, creating the constraints
-			RDKit::Bond *bond       = kekulized_mol.getBondWithIdx(*(bit->begin())); // Starting Bond
-			RDKit::Bond *start_bond = bond, *prev_bond = bond;
-			RDKit::Atom *atom = bond->getBeginAtom();
-			int first_flag    = 1;
-			while (ret == 0 && (first_flag || prev_bond != start_bond)) {
-				bond     = getNextBondInRing(bond, atom, ring_bond_flags);
-				colno[0] = prev_bond->getIdx() + 1;
-				colno[1] = bond->getIdx() + 1;
-				colno[2] = prev_bond->getIdx() + 1 + num_bonds;
-				colno[3] = bond->getIdx() + 1 + num_bonds;
-				if (!add_constraintex(lp, 4, row, colno, LE, 3)) ret = 3;
-				atom       = bond->getOtherAtom(atom);
-				prev_bond  = bond;
-				first_flag = 0;
-			}
+		// Minimum constraint (LP bond + standard bond is at least a single bond)
+		addConstraint(constraints, true, min_limit, {i + 1});
+
+		// Lone pair constraint due to begin atom
+		addConstraint(constraints, false, begin_lp_limit, {num_bonds + i + 1});
+
+		// Lone pair constraint due to end atom
+		addConstraint(constraints, false, end_lp_limit, {2 * num_bonds + i + 1});
+	}
+
+	// Add constraints for neighbouring ring bonds (can't have two double in a row)
+	RDKit::RingInfo *rinfo                       = kekulized_mol.getRingInfo();
+	RDKit::RingInfo::VECT_INT_VECT brings        = rinfo->bondRings();
+	RDKit::RingInfo::VECT_INT_VECT::iterator bit = brings.begin();
+	for (int ringidx = 0; bit != brings.end(); ++bit, ringidx++) {
+
+		if (ringidx == broken_ringidx) continue;
+
+		// Create a vector of flags indicating bonds included in the ring
+		std::vector<int> ring_bond_flags(num_bonds);
+		for (int k = 0; k < num_bonds; k++) ring_bond_flags[k] = 0;
+		RDKit::RingInfo::INT_VECT::iterator it;
+		for (it = bit->begin(); it != bit->end(); ++it) ring_bond_flags[*it] = 1;
+
+		// Traverse around the ring, creating the constraints
+		RDKit::Bond *bond       = kekulized_mol.getBondWithIdx(*(bit->begin())); // Starting Bond
+		RDKit::Bond *start_bond = bond, *prev_bond = bond;
+		RDKit::Atom *atom = bond->getBeginAtom();
+		int first_flag    = 1;
+		while (first_flag || prev_bond != start_bond) {
+			bond = getNextBondInRing(bond, atom, ring_bond_flags);
+			constraints.push_back(milp_constraint_t{false, 3,
+			                                        {(int)prev_bond->getIdx() + 1, (int)bond->getIdx() + 1,
+			                                         (int)prev_bond->getIdx() + 1 + num_bonds,
+			                                         (int)bond->getIdx() + 1 + num_bonds}});
+			atom       = bond->getOtherAtom(atom);
+			prev_bond  = bond;
+			first_flag = 0;
 		}
+	}
 
-		// Add atom valence constraints to neighbouring bonds
-		std::vector<int> lp_indexes(num_atoms, -1);
-		for (i = 0; i < num_atoms && ret == 0; i++) {
-			RDKit::Atom *atom = kekulized_mol.getAtomWithIdx(i);
-			atom->getProp("FragIdx", fragidx);
-			atom->getProp("OrigValence", origval);
-			int ionic_q;
-			atom->getProp("IonicFragmentCharge", ionic_q);
-			int has_lp;
-			atom->getProp("HasLP", has_lp);
-			unsigned int num_ur;
-			atom->getProp("NumUnbrokenRings", num_ur);
-
-			// Charge due to H loss constraints
-			colno[0]          = 3 * num_bonds + i + 1;
-			row[0]            = 1;
-			int hloss_allowed = (!has_lp) && (fragidx == fragmentidx) && (ionic_q == 0) && (num_ur == 0);
-			if (!add_constraintex(lp, 1, row, colno, LE, hloss_allowed)) ret = 3;
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(1, colno, false, hloss_allowed);
-#endif
-			if (ret != 0) break;
-
-			if (fragidx != fragmentidx) continue;
-
-			// Base valence constraints
-			RDKit::ROMol::OEDGE_ITER cbond_beg, cbond_end;
-			boost::tie(cbond_beg, cbond_end) = kekulized_mol.getAtomBonds(atom);
-			// RDKit::ROMol::OEDGE_ITER it = ip.first;
-			int j                            = 0;
-			if (hloss_allowed) j = 1;
-
-			for (; cbond_beg != cbond_end; ++cbond_beg) {
-				// for (; it != ip.second; ++it) {
-				RDKit::Bond *cbond = (*mol)[*cbond_beg];
-				int cbond_broken;
-				cbond->getProp("Broken", cbond_broken);
-				if (cbond_broken) continue;
-
-				colno[j] = cbond->getIdx() + 1; // variable idx i.e. bond
-				row[j++] = 1;                   // multiplier
-				// For atoms that don't contribute the lone pairs,
-				// ensure lone pair bonds are counted towards valence total
-				if (cbond->getBeginAtomIdx() != i) {
-					colno[j] = cbond->getIdx() + 1 + num_bonds;
-					row[j++] = 1;
-				}
-				if (cbond->getEndAtomIdx() != i) {
-					colno[j] = cbond->getIdx() + 1 + 2 * num_bonds;
-					row[j++] = 1;
-				}
-			}
-			if (j > 0) {
-				int val_limit = origval;
-				if (atom->getDegree() > origval) val_limit = atom->getDegree();
-				if (!add_constraintex(lp, j, row, colno, LE, val_limit)) ret = 3;
-#ifdef __DEBUG_CONSTRAINTS__
-				printConstraint(j, colno, false, val_limit);
-#endif
-			}
+	// Add atom valence constraints to neighbouring bonds
+	for (i = 0; i < num_atoms; i++) {
+		RDKit::Atom *atom = kekulized_mol.getAtomWithIdx(i);
+		fragidx             = labels.frag_idx[i];
+		origval             = labels.orig_valence[i];
+		int ionic_q         = labels.ionic_fragment_charge[i];
+		int has_lp          = labels.has_lp[i];
+		unsigned int num_ur = labels.atom_num_unbroken_rings[i];
+
+		// Charge due to H loss constraints
+		int hloss_allowed = (!has_lp) && (fragidx == fragmentidx) && (ionic_q == 0) && (num_ur == 0);
+		addConstraint(constraints, false, hloss_allowed, {3 * num_bonds + i + 1});
+
+		if (fragidx != fragmentidx) continue;
+
+		// Base valence constraints (including any charge due to H loss)
+		std::vector<int> cols;
+		if (hloss_allowed) cols.push_back(3 * num_bonds + i + 1);
+		RDKit::ROMol::OEDGE_ITER cbond_beg, cbond_end;
+		boost::tie(cbond_beg, cbond_end) = kekulized_mol.getAtomBonds(atom);
+		for (; cbond_beg != cbond_end; ++cbond_beg) {
+			RDKit::Bond *cbond = (*mol)[*cbond_beg];
+			if (labels.broken[cbond->getIdx()]) continue;
+
+			cols.push_back(cbond->getIdx() + 1); // variable idx i.e. bond
+			// For atoms that don't contribute the lone pairs,
+			// ensure lone pair bonds are counted towards valence total
+			if (cbond->getBeginAtomIdx() != i) cols.push_back(cbond->getIdx() + 1 + num_bonds);
+			if (cbond->getEndAtomIdx() != i) cols.push_back(cbond->getIdx() + 1 + 2 * num_bonds);
+		}
+		if (!cols.empty()) {
+			int val_limit = origval;
+			if (atom->getDegree() > origval) val_limit = atom->getDegree();
+			addConstraint(constraints, false, val_limit, cols);
 		}
+	}
 
-		// Total Lone Pair bond and H loss constraints - at most one of either used
-		if (ret == 0) {
-			int j = 0;
-			for (i = num_bonds; i < 3 * num_bonds + num_atoms; i++) {
-				colno[j] = i + 1; // variable idx
-				row[j++] = 1;     // multiplier
-			}
-			if (!add_constraintex(lp, j, row, colno, LE, 1)) ret = 3;
+	// Total Lone Pair bond and H loss constraints - at most one of either used
+	std::vector<int> cols;
+	for (i = num_bonds; i < 3 * num_bonds + num_atoms; i++) cols.push_back(i + 1);
+	addConstraint(constraints, false, 1, cols);
+
+	// Add the maximum constraint (no point finding a solution with more electrons than we have)
+	cols.clear();
+	for (int j = 0; j < Ncol; j++) cols.push_back(j + 1);
+	addConstraint(constraints, false, max_free_pairs + min_single_bonds, cols);
+
+	return min_single_bonds;
+}
+
+void MILP::addConstraint(std::vector<milp_constraint_t> &constraints, bool ge, int limit, std::vector<int> cols) {
 #ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(j, colno, false, 1);
+	printConstraint(cols.size(), cols.data(), ge, limit);
 #endif
-		}
+	constraints.push_back(milp_constraint_t{ge, limit, std::move(cols)});
+}
+
+void MILP::solveModel(int Ncol, const std::vector<milp_constraint_t> &constraints, milp_solution_t &solution) {
+	// Uses lp_solve: based on demonstration code provided.
+	int *colno = nullptr, ret = 0;
+	REAL *row  = nullptr;
+	lprec *lp;
+
+	lp = make_lp(0, Ncol);
+	if (lp == nullptr) ret = 1; /* couldn't construct a new model... */
+
+	if (ret == 0) {
+		colno = (int *)malloc(Ncol * sizeof(*colno));
+		row   = (REAL *)malloc(Ncol * sizeof(*row));
+		if ((colno == nullptr) || (row == nullptr)) ret = 2;
+	}
 
-		// Add the maximum constraint (no point finding a solution with more electrons than we have)
-		if (ret == 0) {
-			for (int j = 0; j < Ncol; j++) {
-				colno[j] = j + 1;
-				row[j]   = 1;
+	if (ret == 0) {
+		set_add_rowmode(lp, TRUE);
+		for (auto &constraint : constraints) {
+			int num_terms = (int)constraint.cols.size();
+			for (int j = 0; j < num_terms; j++) {
+				colno[j] = constraint.cols[j];
+				row[j]   = 1; // multiplier
+			}
+			if (!add_constraintex(lp, num_terms, row, colno, constraint.ge ? GE : LE, constraint.limit)) {
+				ret = 3;
+				break;
 			}
-			if (!add_constraintex(lp, Ncol, row, colno, LE, max_free_pairs + min_single_bonds)) ret = 3;
-#ifdef __DEBUG_CONSTRAINTS__
-			printConstraint(Ncol, colno, false, max_free_pairs + min_single_bonds);
-#endif
 		}
 	}
 
@@ -279,59 +314,40 @@ int MILP::runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free
 	}
 
 	// Run optimization
-	// std::cout << "LPSOVLE"  << std::endl;
 	if (ret == 0) {
 		set_maxim(lp);
 		set_verbose(lp, IMPORTANT);
 		// write_lp(lp, "lp_solve_debug.lp");
-		// write_mps(lp, "lp_solve_debug.mps");
-		// set_presolve(lp, PRESOLVE_ROWS, get_presolveloops(lp));
-		// std::cout << get_Ncolumns(lp) << " " << get_Norig_columns(lp) << std::endl;
 		ret = solve(lp);
-
-		if (ret == OPTIMAL) {
-			ret = 0;
-			// std::cout << "OPTIMAL" << std::endl;
-		} else {
-			ret = 5;
-			// std::cout << "NOT OPTIMAL" << std::endl;
-		}
+		ret = ret == OPTIMAL ? 0 : 5;
 	}
 
-	// Extract Results
-	output_bmax.resize(Ncol);
-	if (ret == 0) {
-
+	solution.optimal = ret == 0;
+	if (solution.optimal) {
 		get_variables(lp, row);
-		for (int j = 0; j < Ncol; j++) {
-			output_bmax[j] = (int)row[j];
-			// std::cout << "Column " << j << " has value " <<  (int) row[j] << std::endl;
-		}
-		int obj = get_objective(lp);
-		// std::cout << "obj value " <<  obj << std::endl;
-
-		output_max_e = obj - min_single_bonds;
-	} else {
-		for (int j = 0; j < Ncol; j++) output_bmax[j] = 0;
-	}
-
-	// Combine the lone pair results
-	for (int j = 0; j < num_bonds; j++) output_bmax[j + num_bonds] += output_bmax[j + 2 * num_bonds];
-	// Condense the atom H loss charge position results to a single index (or -1 if none)
-	int hloss_idx[2] = {-1, -1};
-	for (int j = 0; j < num_atoms; j++) {
-		if (output_bmax[j + 3 * num_bonds]) hloss_idx[fragmentidx] = j;
+		solution.values.resize(Ncol);
+		for (int j = 0; j < Ncol; j++) solution.values[j] = (int)row[j];
+		solution.objective = get_objective(lp);
 	}
-	output_bmax.resize(2 * num_bonds + 2);
-	output_bmax[2 * num_bonds]     = hloss_idx[0];
-	output_bmax[2 * num_bonds + 1] = hloss_idx[1];
 
 	// Free allocated memory
 	if (row != nullptr) free(row);
 	if (colno != nullptr) free(colno);
 	if (lp != nullptr) delete_lp(lp);
+}
 
-	return output_max_e;
+std::string MILP::encodeModel(int Ncol, const std::vector<milp_constraint_t> &constraints) {
+
+	// The number of variables, then each constraint's type, limit, term count and variables
+	std::vector<int> ints;
+	ints.push_back(Ncol);
+	for (auto &constraint : constraints) {
+		ints.push_back(constraint.ge);
+		ints.push_back(constraint.limit);
+		ints.push_back((int)constraint.cols.size());
+		ints.insert(ints.end(), constraint.cols.begin(), constraint.cols.end());
+	}
+	return std::string(reinterpret_cast<const char *>(ints.data()), ints.size() * sizeof(int));
 }
 
 // Helper function - allows traversal of a ring one bond at a time
@@ -359,11 +375,7 @@ void MILP::printConstraint(int num_terms, int *colno, bool ge, int val) {
 }
 
 int MILP::getAtomLPLimit(RDKit::Atom *atom) {
-	int has_lp;
-	atom->getProp("HasLP", has_lp);
-	int val;
-	atom->getProp("OrigValence", val);
-	unsigned int num_unbroken;
-	atom->getProp("NumUnbrokenRings", num_unbroken);
-	return (has_lp && (atom->getDegree() <= val) && (num_unbroken == 0));
+	unsigned int idx = atom->getIdx();
+	return (labels.has_lp[idx] && (atom->getDegree() <= labels.orig_valence[idx]) &&
+	        (labels.atom_num_unbroken_rings[idx] == 0));
 }
@@ -18,37 +18,123 @@
 #ifndef __MILP_H__
 #define __MILP_H__
 
+#include "Config.h"
+#include "FragmentLabels.h"
+
 #include <GraphMol/ROMol.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
+// A linear constraint of the model: the sum of the given (1-based) variables
+// is at most (or at least) the limit. All the coefficients in the model are 1.
+struct milp_constraint_t {
+    bool ge;
+    int limit;
+    std::vector<int> cols;
+};
+
+// The result of solving a model
+struct milp_solution_t {
+    bool optimal = false;
+    int objective = 0;
+    std::vector<int> values;
+};
+
+static const size_t MILP_CACHE_NUM_SHARDS = 16;
+static const size_t MILP_CACHE_MAX_ENTRIES_PER_SHARD = 4096;
+
+// Process-wide memo of solved models, keyed by an exact encoding of the model
+// (its variables and constraints in order), so a hit gives exactly the
+// solution lp_solve would. The same fragments, and so the same models, recur
+// constantly within a molecule and across a library. Sharded to keep lock
+// contention low; a full shard is simply cleared.
+class MILPSolutionCache {
+public:
+    static bool fetch(const std::string &key, milp_solution_t &solution);
+
+    static void store(const std::string &key, const milp_solution_t &solution);
+
+    //Turn the cache off (e.g. so tests of the solvers always solve the models)
+    static void setEnabled(bool a_enabled) { enabled = a_enabled; };
+
+    //Forget every stored solution
+    static void clear();
+
+    static long getNumHits() { return num_hits.load(); };
+
+    static long getNumMisses() { return num_misses.load(); };
+
+private:
+    struct shard_t {
+        std::mutex mutex;
+        std::unordered_map<std::string, milp_solution_t> solutions;
+    };
+
+    static shard_t shards[MILP_CACHE_NUM_SHARDS];
+    static std::atomic<long> num_hits, num_misses;
+    static std::atomic<bool> enabled;
+};
+
 class MILP {
 
 public:
-    MILP(RDKit::ROMol *a_mol, int a_fragmentidx, int a_broken_ringidx, bool a_verbose)
-            : mol(a_mol), fragmentidx(a_fragmentidx), broken_ringidx(a_broken_ringidx), verbose(a_verbose) {};
+    MILP(RDKit::ROMol *a_mol, const fragment_labels_t &a_labels, int a_fragmentidx, int a_broken_ringidx,
+         bool a_verbose)
+            : mol(a_mol), labels(a_labels), fragmentidx(a_fragmentidx), broken_ringidx(a_broken_ringidx),
+              verbose(a_verbose) {};
 
-    MILP(RDKit::ROMol *a_mol, int a_fragmentidx, bool a_verbose)
-            : mol(a_mol), fragmentidx(a_fragmentidx), broken_ringidx(-1), verbose(a_verbose) {};
+    MILP(RDKit::ROMol *a_mol, const fragment_labels_t &a_labels, int a_fragmentidx, bool a_verbose)
+            : mol(a_mol), labels(a_labels), fragmentidx(a_fragmentidx), broken_ringidx(-1), verbose(a_verbose) {};
 
-    int runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free_pairs, bool allow_rearrangement);
+    int runSolver(std::vector<int> &output_bmax, bool allow_lp_q, int max_free_pairs, bool allow_rearrangement,
+                  int solver = MILP_SOLVER_LP_SOLVE);
 
     int status;
 
+    //The model and raw solution of the last runSolver call, and the solver that
+    //found it (which is lp_solve if the combinatorial solver gave up)
+    const std::vector<milp_constraint_t> &getConstraints() const { return constraints; };
+
+    const milp_solution_t &getSolution() const { return solution; };
+
+    int getSolverUsed() const { return solver_used; };
+
 private:
     RDKit::ROMol *mol;
+    const fragment_labels_t &labels; //Labels of the mol's atoms and bonds for the applied break
     int fragmentidx;
     int broken_ringidx;        //Store the idx of any broken rings (or -1 if there are none).
     bool verbose;
 
+    std::vector<milp_constraint_t> constraints;
+    milp_solution_t solution;
+    int solver_used = -1;
+
+    //Build the constraints of the model (maximising the sum of all Ncol variables)
+    //for the fragment, returning the number of single bonds it must have
+    int buildModel(RDKit::RWMol &kekulized_mol, std::vector<milp_constraint_t> &constraints, bool allow_lp_q,
+                   int max_free_pairs, bool allow_rearrangement);
+
+    void addConstraint(std::vector<milp_constraint_t> &constraints, bool ge, int limit, std::vector<int> cols);
+
+    //Solve the model with lp_solve
+    static void solveModel(int Ncol, const std::vector<milp_constraint_t> &constraints, milp_solution_t &solution);
+
+    static std::string encodeModel(int Ncol, const std::vector<milp_constraint_t> &constraints);
+
     //Helper functions:
     //Allows traversal of a ring one bond at a time
     RDKit::Bond *getNextBondInRing(RDKit::Bond *bond, RDKit::Atom *atom, std::vector<int> &ring_bond_flags);
 
     //Checks whether an atom should be allowed a lone pair bond (not including those already using theirs to create an extra single bond)
-    static int getAtomLPLimit(RDKit::Atom *atom);
+    int getAtomLPLimit(RDKit::Atom *atom);
 
     void printConstraint(int num_terms, int *colno, bool ge, int val);
 
 };
 
-#endif // __MILP_H__
\ No newline at end of file
+#endif // __MILP_H__
@@ -27,6 +27,7 @@ probabilities using those thetas.
 #include "MolData.h"
 #include "Comparators.h"
 #include "Inference.h"
+#include "PredictionProfile.h"
 #include "Version.h"
 
 #include <GraphMol/Descriptors/MolDescriptors.h>
@@ -125,11 +126,19 @@ void MolData::computeLikelyFragmentGraphAndSetThetas(LikelyFragmentGraphGenerato
 	fg                          = fgen.createNewGraph(cfg);
 	FragmentTreeNode *startnode = fgen.createStartNode(smiles_or_inchi, cfg->ionization_mode);
 
-	fgen.compute(*startnode, cfg->fg_depth, -1, 0.0, cfg->max_ring_breaks);
+	try {
+		fgen.compute(*startnode, cfg->fg_depth, -1, 0.0, cfg->max_ring_breaks);
+	} catch (...) {
+		// The generator is reused for the next molecule, so don't leak the tree on failure
+		delete startnode;
+		throw;
+	}
 	if (!cfg->allow_frag_detours) fg->removeDetours();
 
 	delete startnode;
 	graph_computed = true;
+	PredictionProfile::count(COUNT_FRAGMENTS, fg->getNumFragments());
+	PredictionProfile::count(COUNT_TRANSITIONS, fg->getNumTransitions());
 
 	// Copy all the theta values up into the mol data and delete the tmp thetas
 	const unsigned int num_levels = cfg->spectrum_depths.size();
@@ -504,8 +513,11 @@ void MolData::createSpeactraSingleEnergry(unsigned int energy_level) {
 
 	// Run forward inference
 	std::vector<Message> msgs;
-	Inference infer(this, &se_cfg);
-	infer.runInferenceDownwardPass(msgs, depth, energy_level);
+	{
+		ProfileStageTimer timer(STAGE_INFERENCE);
+		Inference infer(this, &se_cfg);
+		infer.runInferenceDownwardPass(msgs, depth, energy_level);
+	}
 
 	// Extract the peaks from the relevant message
 	int msg_depth = depth - 1; // se_cfg.spectrum_depths[0] - 1;
@@ -686,20 +698,20 @@ void MolData::outputSpectra(std::ostream &out, const char *spec_type, bool do_an
 		case (POSITIVE_EI_IONIZATION_MODE): spectra_str = "EI-MS Spectra"; break;
 		default: break;
 		}
-		out << "#In-silico " << spectra_str << std::endl
-		    << "#PREDICTED BY " << APP_STRING << " " << PROJECT_VER << std::endl;
-		out << "#ID=" << this->getId() << std::endl;
+		out << "#In-silico " << spectra_str << "\n"
+		    << "#PREDICTED BY " << APP_STRING << " " << PROJECT_VER << "\n";
+		out << "#ID=" << this->getId() << "\n";
 		if (smiles_or_inchi.substr(0, 6) == "InChI=") {
-			out << "#" << smiles_or_inchi << std::endl;
-			out << "#InChiKey=" << RDKit::InchiToInchiKey(smiles_or_inchi) << std::endl;
+			out << "#" << smiles_or_inchi << "\n";
+			out << "#InChiKey=" << RDKit::InchiToInchiKey(smiles_or_inchi) << "\n";
 		} else {
 			RDKit::RWMol *rwmol;
-			out << "#SMILES=" << smiles_or_inchi << std::endl;
+			out << "#SMILES=" << smiles_or_inchi << "\n";
 			rwmol = RDKit::SmilesToMol(smiles_or_inchi);
 			RDKit::ExtraInchiReturnValues rv;
-			out << "#InChiKey=" << RDKit::InchiToInchiKey(RDKit::MolToInchi(*rwmol, rv)) << std::endl;
-			out << "#Formula=" << RDKit::Descriptors::calcMolFormula(*rwmol) << std::endl;
-			out << "#PMass=" << std::fixed << std::setprecision(5) << getParentIonMass() << std::endl;
+			out << "#InChiKey=" << RDKit::InchiToInchiKey(RDKit::MolToInchi(*rwmol, rv)) << "\n";
+			out << "#Formula=" << RDKit::Descriptors::calcMolFormula(*rwmol) << "\n";
+			out << "#PMass=" << std::fixed << std::setprecision(5) << getParentIonMass() << "\n";
 			delete rwmol;
 		}
 	}
@@ -707,13 +719,13 @@ void MolData::outputSpectra(std::ostream &out, const char *spec_type, bool do_an
 	auto it = spectra_to_output->begin();
 	std::set<int> frag_ids;
 	for (int energy = 0; it != spectra_to_output->end(); ++it, energy++) {
-		out << "energy" << energy << std::endl;
+		out << "energy" << energy << "\n";
 		it->outputToStream(out, do_annotate, cfg->default_mz_decimal_place, true);
 		it->getDisplayedFragmentIds(frag_ids);
 	}
 
 	if (do_annotate) {
-		out << std::endl;
+		out << "\n";
 		writeFragmentsOnlyForIds(out, frag_ids);
 	}
 }
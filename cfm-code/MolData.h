@@ -66,6 +66,10 @@ public:
 
 	const Spectrum *getPredictedSpectrum(int energy) const { return &(predicted_spectra[energy]); };
 
+	const std::vector<Spectrum> *getPredictedSpectra() const { return &predicted_spectra; };
+
+	void setPredictedSpectra(const std::vector<Spectrum> &spectra_to_set) { predicted_spectra = spectra_to_set; };
+
 	unsigned int getNumSpectra() const { return spectra.size(); };
 
 	unsigned int getNumPredictedSpectra() const { return predicted_spectra.size(); };
@@ -107,6 +111,14 @@ public:
 		std::vector<Spectrum>().swap(predicted_spectra);
 	};
 
+	// Free the fragment graph and thetas (e.g. once spectra have been predicted from them)
+	void freeFragmentGraph() {
+		delete fg;
+		fg             = nullptr;
+		graph_computed = false;
+		std::vector<std::vector<double>>().swap(thetas);
+	};
+
 	// Spectrum Related Functions
 	std::string removePeaksWithNoFragment(double abs_tol, double ppm_tol);
 
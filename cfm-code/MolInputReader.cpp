@@ -0,0 +1,105 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# MolInputReader.cpp
+#
+# Description: 	Class for streaming a list of <id smiles_or_inchi> pairs
+#				from a (possibly gzip compressed) input file.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "MolInputReader.h"
+
+#include <iostream>
+#include <sstream>
+
+#include <boost/iostreams/filter/gzip.hpp>
+
+MolInputReader::MolInputReader(const std::string &filename, size_t a_max_queued) : max_queued(a_max_queued) {
+
+	bool compressed = filename.size() > 3 && filename.substr(filename.size() - 3) == ".gz";
+	ifs.open(filename.c_str(), compressed ? std::ifstream::in | std::ifstream::binary : std::ifstream::in);
+	if (!ifs.good()) {
+		std::cout << "Could not open input file: " << filename << std::endl;
+		throw MolInputReadException();
+	}
+	if (compressed) in.push(boost::iostreams::gzip_decompressor());
+	in.push(ifs);
+
+	reader = std::thread(&MolInputReader::readInput, this);
+}
+
+MolInputReader::~MolInputReader() {
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		stop_reading = true;
+	}
+	queue_not_full.notify_all();
+	reader.join();
+}
+
+bool MolInputReader::next(mol_input_t &mol) {
+
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	queue_not_empty.wait(lock, [this] { return !queue.empty() || finished_reading; });
+	if (queue.empty()) {
+		if (read_failure) std::rethrow_exception(read_failure);
+		return false;
+	}
+
+	mol = queue.front();
+	queue.pop_front();
+	lock.unlock();
+	queue_not_full.notify_one();
+	return true;
+}
+
+void MolInputReader::readInput() {
+
+	std::string line;
+	size_t input_idx = 0;
+	bool stopped = false;
+	std::exception_ptr failure;
+	try {
+		while (getline(in, line)) {
+			if (line.size() < 3) continue;
+
+			mol_input_t mol;
+			std::stringstream ss(line);
+			ss >> mol.id >> mol.smiles_or_inchi;
+			mol.input_idx = input_idx++;
+
+			std::unique_lock<std::mutex> lock(queue_mutex);
+			queue_not_full.wait(lock, [this] { return queue.size() < max_queued || stop_reading; });
+			if (stop_reading) {
+				stopped = true;
+				break;
+			}
+			queue.push_back(mol);
+			lock.unlock();
+			queue_not_empty.notify_one();
+		}
+		// An error in the decompressor can also just end getline, leaving the stream bad
+		if (in.bad() && !stopped) throw MolInputReadException("Error reading molecule input file.");
+	} catch (boost::iostreams::gzip_error &e) {
+		std::cerr << "Error decompressing input file: " << e.what() << std::endl;
+		failure = std::make_exception_ptr(MolInputReadException("Error decompressing molecule input file."));
+	} catch (...) {
+		// Anything else is passed on to the consumers, rather than escaping the thread
+		failure = std::current_exception();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		finished_reading = true;
+		read_failure     = failure;
+	}
+	queue_not_empty.notify_all();
+}
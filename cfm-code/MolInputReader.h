@@ -0,0 +1,89 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# MolInputReader.h
+#
+# Description: 	Class for streaming a list of <id smiles_or_inchi> pairs
+#				from a (possibly gzip compressed) input file.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __MOL_INPUT_READER_H__
+#define __MOL_INPUT_READER_H__
+
+#include <boost/iostreams/filtering_stream.hpp>
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class MolInputReadException : public std::exception {
+public:
+    MolInputReadException(const std::string &a_message = "Could not open molecule input file.") :
+            message(a_message) {};
+
+    virtual const char *what() const noexcept {
+        return message.c_str();
+    }
+
+private:
+    std::string message;
+};
+
+// An input molecule and its position in the input file
+struct mol_input_t {
+    std::string id;
+    std::string smiles_or_inchi;
+    size_t input_idx;
+};
+
+// Reads an input list (one <id smiles_or_inchi> pair per line, files ending in .gz
+// are decompressed on the fly) on a background thread, into a queue holding at most
+// max_queued molecules. Memory use therefore doesn't grow with the size of the input,
+// and consumers can start before the whole file has been read.
+class MolInputReader {
+public:
+    //Constructor - throws MolInputReadException if the file can't be opened
+    MolInputReader(const std::string &filename, size_t a_max_queued = 1024);
+
+    MolInputReader(const MolInputReader &) = delete;
+
+    MolInputReader &operator=(const MolInputReader &) = delete;
+
+    ~MolInputReader();
+
+    //Fetch the next molecule, waiting for it to be read if necessary. Returns
+    //false once the input is exhausted. If reading failed part way (e.g. a corrupt
+    //gzip file), the failure is rethrown once the molecules read before it are
+    //taken, and on every call after that. Safe to call from several threads.
+    bool next(mol_input_t &mol);
+
+private:
+    std::ifstream ifs;
+    boost::iostreams::filtering_istream in;
+
+    size_t max_queued;
+    std::deque<mol_input_t> queue;
+    bool finished_reading = false;
+    bool stop_reading = false;
+    std::exception_ptr read_failure;
+    std::mutex queue_mutex;
+    std::condition_variable queue_not_empty, queue_not_full;
+
+    std::thread reader;
+
+    void readInput();
+};
+
+#endif // __MOL_INPUT_READER_H__
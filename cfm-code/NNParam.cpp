@@ -18,6 +18,7 @@
 
 #include "NNParam.h"
 #include "Config.h"
+#include "PredictionProfile.h"
 
 NNParam::NNParam(std::vector<std::string> a_feature_list, int a_num_energy_levels,
                  std::vector<int> &a_hlayer_num_nodes, std::vector<int> &a_act_func_ids,
@@ -55,11 +56,6 @@ NNParam::NNParam(std::vector<std::string> a_feature_list, int a_num_energy_level
     //Set pointers to the activation functions and their derivatives used in each layer
     setActivationFunctionsFromIds();
 
-    //Resize some temporary a and z vectors so we don't have to
-    // allocate memory for a and z within the computeTheta function if we don't need them after.
-    tmp_z_values.resize(total_nodes);
-    tmp_a_values.resize(total_nodes);
-
     //Roll Drop outs
     //last dropped out for output node
     //add this one for not to break stuff
@@ -155,7 +151,12 @@ void NNParam::varianceScalingInit() {
 }
 
 float NNParam::computeTheta(const FeatureVector &fv, int energy) {
-    return computeTheta(fv, energy, tmp_z_values, tmp_a_values, true, false);
+    // Scratch a and z vectors are kept per thread, so that one set of parameters
+    // can be shared by several prediction threads. They are only reallocated if
+    // the network size changes.
+    static thread_local azd_vals_t tmp_z_values, tmp_a_values;
+    ProfileStageTimer timer(STAGE_COMPUTE_THETA);
+    return computeTheta(fv, energy, tmp_z_values, tmp_a_values, false, false);
 }
 
 float NNParam::computeTheta(const FeatureVector &fv, int energy, azd_vals_t &z_values, azd_vals_t &a_values,
@@ -333,8 +334,6 @@ NNParam::NNParam(std::string &filename) : Param(filename) {
                     ss4 >> hlayer_is_frozen[i];
             }
 
-            tmp_z_values.resize(total_nodes);
-            tmp_a_values.resize(total_nodes);
             found_nn_details = true;
             break;
         }
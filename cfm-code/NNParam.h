@@ -59,6 +59,7 @@ public:
     //Compute the theta value for an input feature vector and energy
     //based on the current weight settings
     //is should only be used in prediction phase or compute loss
+    //(thread safe: uses per-thread scratch space)
     float computeTheta(const FeatureVector &fv, int energy);
 
     // Compute the theta value for an input feature vector and energy in training time
@@ -146,8 +147,6 @@ private:
     //Function to configure activation functions used in each layer
     void setActivationFunctionsFromIds();
 
-    azd_vals_t tmp_z_values, tmp_a_values;
-
 };
 
 
@@ -17,6 +17,9 @@
 
 #include "Param.h"
 #include "Config.h"
+#include "PredictionProfile.h"
+
+#include <algorithm>
 
 //Constructor to initialise parameter weight size from a feature list
 Param::Param(std::vector<std::string> a_feature_list, int a_num_energy_levels) :
@@ -155,6 +158,7 @@ void Param::fullZeroInit() {
 
 float Param::computeTheta(const FeatureVector &fv, int energy) {
 
+    ProfileStageTimer timer(STAGE_COMPUTE_THETA);
     float theta = 0.0;
     //Check Feature Length
     int len = fv.getTotalLength();
@@ -171,6 +175,15 @@ float Param::computeTheta(const FeatureVector &fv, int energy) {
     return theta;
 }
 
+float Param::computeMaxThetaOfRange(unsigned int begin, unsigned int end, int energy) {
+
+    float max_theta = 0.0;
+    int energy_offset = expected_num_input_features * energy;
+    for (unsigned int idx = begin; idx < end; idx++)
+        max_theta += std::max(0.0f, weights[idx + energy_offset]);
+    return max_theta;
+}
+
 void Param::saveToFile(std::string &filename) {
 
     std::ofstream out;
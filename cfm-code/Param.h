@@ -58,6 +58,10 @@ public:
     //on the current weight settings
     virtual float computeTheta(const FeatureVector &fv, int energy);
 
+    //The most the features in [begin, end) can add to theta at an energy (features
+    //being 0 or 1), for bounding theta when only some of the features are known
+    float computeMaxThetaOfRange(unsigned int begin, unsigned int end, int energy);
+
     //Set the value of a weight
     void setWeightAtIdx(float value, int index) { weights[index] = value; };
 
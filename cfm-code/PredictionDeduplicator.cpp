@@ -0,0 +1,44 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# PredictionDeduplicator.cpp
+#
+# Description: 	Shares predicted spectra between inputs that only differ in
+#				stereochemistry (or not at all), so each is predicted once.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "PredictionDeduplicator.h"
+
+PredictionDeduplicator::claim_t PredictionDeduplicator::claimOrFetch(const std::string &key,
+                                                                     std::vector<Spectrum> &spectra) {
+
+	std::shared_future<std::vector<Spectrum>> result;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		auto it = results.find(key);
+		if (it == results.end()) {
+			claim_t claim = std::make_shared<std::promise<std::vector<Spectrum>>>();
+			results.emplace(key, claim->get_future().share());
+			keys_in_order.push_back(key);
+			if (keys_in_order.size() > max_entries) {
+				results.erase(keys_in_order.front());
+				keys_in_order.pop_front();
+			}
+			return claim;
+		}
+		result = it->second;
+	}
+
+	// Wait outside the lock, so other inputs aren't held up
+	spectra = result.get();
+	num_shared++;
+	return nullptr;
+}
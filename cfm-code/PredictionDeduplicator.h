@@ -0,0 +1,62 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# PredictionDeduplicator.h
+#
+# Description: 	Shares predicted spectra between inputs that only differ in
+#				stereochemistry (or not at all), so each is predicted once.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __PREDICTION_DEDUPLICATOR_H__
+#define __PREDICTION_DEDUPLICATOR_H__
+
+#include "Spectrum.h"
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Inputs are keyed by their canonical smiles without stereochemistry (see
+// FragmentGraphGenerator::getCanonicalNonStereoSmiles), which is all the
+// fragment graph is built from. The first input with a key is predicted,
+// and any later ones (from any thread) are given its spectra, waiting for
+// them if they are still being predicted. Only the most recent max_entries
+// keys are remembered.
+class PredictionDeduplicator {
+public:
+    typedef std::shared_ptr<std::promise<std::vector<Spectrum>>> claim_t;
+
+    explicit PredictionDeduplicator(size_t a_max_entries) : max_entries(a_max_entries), num_shared(0) {};
+
+    // Returns null, with the spectra set, if an input with the key came first (rethrowing
+    // whatever its prediction threw). Otherwise the caller is to predict the spectra and
+    // give them to the returned claim (set_value), or what was thrown (set_exception).
+    claim_t claimOrFetch(const std::string &key, std::vector<Spectrum> &spectra);
+
+    // Number of inputs given the spectra of an earlier one
+    long getNumShared() const { return num_shared.load(); };
+
+private:
+    size_t max_entries;
+    std::atomic<long> num_shared;
+
+    std::mutex mutex;
+    std::unordered_map<std::string, std::shared_future<std::vector<Spectrum>>> results;
+    std::deque<std::string> keys_in_order;
+};
+
+#endif // __PREDICTION_DEDUPLICATOR_H__
@@ -0,0 +1,90 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# PredictionProfile.cpp
+#
+# Description: 	Optional per-molecule timing and counters for the stages
+#				of spectrum prediction.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "PredictionProfile.h"
+
+#include <iomanip>
+
+thread_local PredictionProfile *PredictionProfile::active = nullptr;
+
+PredictionProfile::PredictionProfile() {
+	for (auto &ns : stage_nanoseconds) ns.store(0);
+	for (auto &count : counts) count.store(0);
+}
+
+const char *PredictionProfile::getStageName(prediction_stage_t stage) {
+	switch (stage) {
+	case STAGE_CREATE_START_NODE: return "create_start_node";
+	case STAGE_GENERATE_BREAKS: return "generate_breaks";
+	case STAGE_GENERATE_CHILDREN: return "generate_children";
+	case STAGE_MILP_SOLVE: return "milp_solve";
+	case STAGE_COMPUTE_FEATURES: return "compute_features";
+	case STAGE_COMPUTE_THETA: return "compute_theta";
+	case STAGE_INFERENCE: return "inference";
+	case STAGE_POSTPROCESS: return "postprocess";
+	default: return "unknown";
+	}
+}
+
+const char *PredictionProfile::getCounterName(prediction_counter_t counter) {
+	switch (counter) {
+	case COUNT_FRAGMENTS: return "fragments";
+	case COUNT_TRANSITIONS: return "transitions";
+	case COUNT_MILP_SOLVES: return "milp_solves";
+	case COUNT_MILP_CACHE_HITS: return "milp_cache_hits";
+	case COUNT_MILP_FALLBACKS: return "milp_fallbacks";
+	case COUNT_EXPANSION_CACHE_HITS: return "expansion_cache_hits";
+	case COUNT_PRUNED_BREAKS: return "pruned_breaks";
+	case COUNT_DEDUP_MATCHES: return "dedup_matches";
+	default: return "unknown";
+	}
+}
+
+// Escape a string for use as a JSON string value
+static void writeJsonString(std::ostream &out, const std::string &str) {
+	out << '"';
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			out << '\\' << c;
+		else if (static_cast<unsigned char>(c) < 0x20)
+			out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else
+			out << c;
+	}
+	out << '"';
+}
+
+void PredictionProfile::writeJsonLine(std::ostream &out, const std::string &id, const std::string &status,
+                                      double total_seconds) const {
+
+	out << "{\"id\": ";
+	writeJsonString(out, id);
+	out << ", \"status\": ";
+	writeJsonString(out, status);
+	out << ", \"total_seconds\": " << total_seconds << ", \"stage_seconds\": {";
+	for (int stage = 0; stage < NUM_PREDICTION_STAGES; stage++) {
+		if (stage > 0) out << ", ";
+		out << '"' << getStageName((prediction_stage_t)stage) << "\": " << getSeconds((prediction_stage_t)stage);
+	}
+	out << "}, \"counts\": {";
+	for (int counter = 0; counter < NUM_PREDICTION_COUNTERS; counter++) {
+		if (counter > 0) out << ", ";
+		out << '"' << getCounterName((prediction_counter_t)counter)
+		    << "\": " << getCount((prediction_counter_t)counter);
+	}
+	out << "}}\n";
+}
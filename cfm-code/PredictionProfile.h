@@ -0,0 +1,123 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# PredictionProfile.h
+#
+# Description: 	Optional per-molecule timing and counters for the stages
+#				of spectrum prediction.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __PREDICTION_PROFILE_H__
+#define __PREDICTION_PROFILE_H__
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// Timed stages. Times are inclusive, so e.g. generate_children includes the
+// milp_solve time of the solves it makes.
+enum prediction_stage_t {
+    STAGE_CREATE_START_NODE,
+    STAGE_GENERATE_BREAKS,
+    STAGE_GENERATE_CHILDREN,
+    STAGE_MILP_SOLVE,
+    STAGE_COMPUTE_FEATURES,
+    STAGE_COMPUTE_THETA,
+    STAGE_INFERENCE,
+    STAGE_POSTPROCESS,
+    NUM_PREDICTION_STAGES
+};
+
+enum prediction_counter_t {
+    COUNT_FRAGMENTS,
+    COUNT_TRANSITIONS,
+    COUNT_MILP_SOLVES,
+    COUNT_MILP_CACHE_HITS, // Solves answered from the MILP solution cache
+    COUNT_MILP_FALLBACKS,  // Models the combinatorial solver handed back to lp_solve
+    COUNT_EXPANSION_CACHE_HITS, // Fragments whose children came from the expansion cache
+    COUNT_PRUNED_BREAKS, // Breaks skipped as their children were certain to be unlikely
+    COUNT_DEDUP_MATCHES, // Substructure matches made to find already seen fragments
+    NUM_PREDICTION_COUNTERS
+};
+
+// Accumulates stage times and counts for one molecule. Nothing is recorded
+// unless a profile has been made active on the calling thread, so the stages
+// cost only a thread_local lookup when profiling is off. Totals are atomic, so
+// several threads working on the same molecule may share one profile.
+class PredictionProfile {
+public:
+    PredictionProfile();
+
+    PredictionProfile(const PredictionProfile &) = delete;
+
+    PredictionProfile &operator=(const PredictionProfile &) = delete;
+
+    void addTime(prediction_stage_t stage, std::chrono::steady_clock::duration elapsed) {
+        stage_nanoseconds[stage].fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                                           std::memory_order_relaxed);
+    };
+
+    void addCount(prediction_counter_t counter, long n = 1) {
+        counts[counter].fetch_add(n, std::memory_order_relaxed);
+    };
+
+    double getSeconds(prediction_stage_t stage) const { return stage_nanoseconds[stage].load() * 1e-9; };
+
+    long getCount(prediction_counter_t counter) const { return counts[counter].load(); };
+
+    //Write the profile as one line of JSON
+    void writeJsonLine(std::ostream &out, const std::string &id, const std::string &status,
+                       double total_seconds) const;
+
+    //The profile that stages on this thread are recorded in (nullptr = not profiling)
+    static PredictionProfile *getActive() { return active; };
+
+    static void setActive(PredictionProfile *profile) { active = profile; };
+
+    //Add to a counter of the active profile, if there is one
+    static void count(prediction_counter_t counter, long n = 1) {
+        if (active != nullptr) active->addCount(counter, n);
+    };
+
+    static const char *getStageName(prediction_stage_t stage);
+
+    static const char *getCounterName(prediction_counter_t counter);
+
+private:
+    std::atomic<long long> stage_nanoseconds[NUM_PREDICTION_STAGES];
+    std::atomic<long> counts[NUM_PREDICTION_COUNTERS];
+
+    static thread_local PredictionProfile *active;
+};
+
+// Times the enclosing scope as a stage of the active profile (if any)
+class ProfileStageTimer {
+public:
+    explicit ProfileStageTimer(prediction_stage_t a_stage) : stage(a_stage), profile(PredictionProfile::getActive()) {
+        if (profile != nullptr) start = std::chrono::steady_clock::now();
+    };
+
+    ProfileStageTimer(const ProfileStageTimer &) = delete;
+
+    ProfileStageTimer &operator=(const ProfileStageTimer &) = delete;
+
+    ~ProfileStageTimer() {
+        if (profile != nullptr) profile->addTime(stage, std::chrono::steady_clock::now() - start);
+    };
+
+private:
+    prediction_stage_t stage;
+    PredictionProfile *profile;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif // __PREDICTION_PROFILE_H__
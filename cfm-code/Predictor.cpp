@@ -0,0 +1,93 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# Predictor.cpp
+#
+# Description: 	Library interface for predicting spectra with a trained
+#				CFM model, for embedding prediction in other programs.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "Predictor.h"
+#include "MolData.h"
+
+#include <boost/filesystem.hpp>
+
+Predictor::Predictor(const std::string &param_filename, const std::string &config_filename) {
+
+	std::string cfg_filename = config_filename;
+	if (!boost::filesystem::exists(cfg_filename)) throw PredictorFileException(cfg_filename);
+	initConfig(cfg, cfg_filename, nullptr, false);
+
+	std::string prm_filename = param_filename;
+	if (!boost::filesystem::exists(prm_filename)) throw PredictorFileException(prm_filename);
+	if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION)
+		nn_param = new NNParam(prm_filename);
+	else
+		param = new Param(prm_filename);
+}
+
+Predictor::~Predictor() {
+	for (auto &it : idle_generators) delete it.second;
+	delete param;
+	delete nn_param;
+}
+
+std::vector<Spectrum> Predictor::predict(const std::string &smiles_or_inchi, const prediction_options_t &options) {
+
+	double perc_thresh        = options.postprocessing_energy < 0 ? cfg.default_postprocessing_energy
+	                                                              : options.postprocessing_energy;
+	int min_peaks             = options.min_peaks < 0 ? cfg.default_predicted_peak_min : options.min_peaks;
+	int max_peaks             = options.max_peaks < 0 ? cfg.default_predicted_peak_max : options.max_peaks;
+	double min_peak_intensity = options.min_peak_intensity < 0 ? cfg.default_predicted_min_intensity
+	                                                           : options.min_peak_intensity;
+
+	LikelyFragmentGraphGenerator *fgen = acquireGenerator(options.prob_thresh_for_prune);
+	MolData mol_data("NullId", smiles_or_inchi.c_str(), &cfg);
+	try {
+		mol_data.computeLikelyFragmentGraphAndSetThetas(*fgen, false);
+		mol_data.computePredictedSpectra(nn_param != nullptr ? *nn_param : *param, true, -1, min_peaks, max_peaks,
+		                                 perc_thresh, min_peak_intensity, cfg.default_mz_decimal_place,
+		                                 cfg.use_log_scale_peak);
+	} catch (...) {
+		releaseGenerator(fgen, options.prob_thresh_for_prune);
+		throw;
+	}
+	releaseGenerator(fgen, options.prob_thresh_for_prune);
+
+	return *mol_data.getPredictedSpectra();
+}
+
+LikelyFragmentGraphGenerator *Predictor::acquireGenerator(double prob_thresh_for_prune) {
+
+	{
+		std::lock_guard<std::mutex> lock(generators_mutex);
+		auto it = idle_generators.find(prob_thresh_for_prune);
+		if (it != idle_generators.end()) {
+			LikelyFragmentGraphGenerator *generator = it->second;
+			idle_generators.erase(it);
+			return generator;
+		}
+	}
+
+	// None free, so make another (outside the lock, this parses the functional group catalogues)
+	if (nn_param != nullptr) return new LikelyFragmentGraphGenerator(nn_param, &cfg, prob_thresh_for_prune);
+	return new LikelyFragmentGraphGenerator(param, &cfg, prob_thresh_for_prune);
+}
+
+void Predictor::releaseGenerator(LikelyFragmentGraphGenerator *generator, double prob_thresh_for_prune) {
+
+	std::lock_guard<std::mutex> lock(generators_mutex);
+	idle_generators.insert(std::make_pair(prob_thresh_for_prune, generator));
+}
+
+std::shared_ptr<Predictor> loadModel(const std::string &param_filename, const std::string &config_filename) {
+	return std::make_shared<Predictor>(param_filename, config_filename);
+}
@@ -0,0 +1,95 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# Predictor.h
+#
+# Description: 	Library interface for predicting spectra with a trained
+#				CFM model, for embedding prediction in other programs.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __PREDICTOR_H__
+#define __PREDICTOR_H__
+
+#include "Config.h"
+#include "FragmentGraphGenerator.h"
+#include "NNParam.h"
+#include "Param.h"
+#include "Spectrum.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Exception to throw when the model's param or config file can't be found
+class PredictorFileException : public std::exception {
+public:
+    PredictorFileException(const std::string &filename) : message("Could not find file: " + filename) {};
+
+    const char *what() const noexcept override { return message.c_str(); }
+
+private:
+    std::string message;
+};
+
+// Settings for a single prediction. Negative values mean use the default from
+// the model's config (as cfm-predict does with its default post-processing).
+struct prediction_options_t {
+    double prob_thresh_for_prune = 0.001;
+    int min_peaks = -1;
+    int max_peaks = -1;
+    double postprocessing_energy = -1;
+    double min_peak_intensity = -1;
+};
+
+// A loaded model (parameters and config) that can predict spectra for any
+// number of molecules. predict is reentrant, so one Predictor can be shared by
+// any number of threads. Fragment graph generators (each with its own
+// FeatureCalculator and FeatureHelper) are kept in a pool and reused between
+// calls, rather than being set up again for every molecule.
+class Predictor {
+public:
+    //Constructor - load the parameters and config from file
+    Predictor(const std::string &param_filename, const std::string &config_filename);
+
+    Predictor(const Predictor &) = delete;
+
+    Predictor &operator=(const Predictor &) = delete;
+
+    ~Predictor();
+
+    //Predict the spectra (one per energy level) for a smiles or inchi string.
+    //Throws the same exceptions as cfm-predict reports (e.g. RDKit::SmilesParseException,
+    //FragmentGraphGenerationException, FragmentGraphTimeoutException)
+    std::vector<Spectrum> predict(const std::string &smiles_or_inchi,
+                                  const prediction_options_t &options = prediction_options_t());
+
+    const config_t *getConfig() const { return &cfg; };
+
+private:
+    config_t cfg;
+    Param *param = nullptr;
+    NNParam *nn_param = nullptr;
+
+    //Idle generators, by their pruning threshold
+    std::multimap<double, LikelyFragmentGraphGenerator *> idle_generators;
+    std::mutex generators_mutex;
+
+    LikelyFragmentGraphGenerator *acquireGenerator(double prob_thresh_for_prune);
+
+    void releaseGenerator(LikelyFragmentGraphGenerator *generator, double prob_thresh_for_prune);
+};
+
+//Load a model that can be shared by the whole program
+std::shared_ptr<Predictor> loadModel(const std::string &param_filename, const std::string &config_filename);
+
+#endif // __PREDICTOR_H__
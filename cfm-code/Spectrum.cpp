@@ -15,6 +15,7 @@
 #########################################################################*/
 
 #include "Spectrum.h"
+#include "PredictionProfile.h"
 #include "Util.h"
 #include "Version.h"
 
@@ -50,7 +51,7 @@ void Spectrum::outputToStream(std::ostream &out, bool do_annotate, int mz_precis
                     out << " " << ss_values.str();
             }
 
-            out << std::endl;
+            out << "\n";
         }
     }
 }
@@ -81,25 +82,25 @@ void Spectrum::outputToMspStream(std::ostream &out, std::string id, int ionizati
         out << "Name: +ve in-silico MS/MS by ";
     else
         out << "Name: -ve in-silico MS/MS by ";
-    out << APP_STRING << " " << PROJECT_VER << " for " << id << std::endl;
-    out << "ID: " << id << std::endl;
-    out << "Smiles/Inchi:" << smiles_or_inchi << std::endl;
-    out << "Comment: Energy" << energy << std::endl;
-    out << "Num peaks: " << peaks.size() << std::endl;
+    out << APP_STRING << " " << PROJECT_VER << " for " << id << "\n";
+    out << "ID: " << id << "\n";
+    out << "Smiles/Inchi:" << smiles_or_inchi << "\n";
+    out << "Comment: Energy" << energy << "\n";
+    out << "Num peaks: " << peaks.size() << "\n";
     outputToStream(out, false, mz_precision, true);
-    out << std::endl;
+    out << "\n";
 }
 
 void Spectrum::outputToMgfStream(std::ostream &out, std::string id, int ionization_mode, int energy, double mw,
                                  std::string &smiles_or_inchi, int mz_precision) const {
 
-    out << "BEGIN IONS" << std::endl;
-    out << "PEPMASS=" << std::setprecision(10) << mw << std::endl;
+    out << "BEGIN IONS" << "\n";
+    out << "PEPMASS=" << std::setprecision(10) << mw << "\n";
     if (ionization_mode == POSITIVE_ESI_IONIZATION_MODE ||
     ionization_mode == POSITIVE_EI_IONIZATION_MODE)
-        out << "CHARGE=1+" << std::endl;
+        out << "CHARGE=1+" << "\n";
     else if (ionization_mode == NEGATIVE_ESI_IONIZATION_MODE)
-        out << "CHARGE=1-" << std::endl;
+        out << "CHARGE=1-" << "\n";
     out << "TITLE=" << id << ";Energy" << energy << ";";
     if (ionization_mode == POSITIVE_EI_IONIZATION_MODE)
         out << "[M]+;In-silico MS by ";
@@ -108,9 +109,9 @@ void Spectrum::outputToMgfStream(std::ostream &out, std::string id, int ionizati
     else if (ionization_mode == NEGATIVE_ESI_IONIZATION_MODE)
         out << "[M-H]-;In-silico MS/MS by ";
     out << APP_STRING << " " << PROJECT_VER << ";"
-    << smiles_or_inchi << ";" << std::endl;
+    << smiles_or_inchi << ";" << "\n";
     outputToStream(out, false, mz_precision, true);
-    out << "END IONS" << std::endl;
+    out << "END IONS" << "\n";
 }
 
 void Spectrum::quantisePeaksByMass(int num_dec_places) {
@@ -140,6 +141,7 @@ void Spectrum::quantisePeaksByMass(int num_dec_places) {
 
 void Spectrum::postProcess(double perc_thresh, int min_peaks, int max_peaks, double min_relative_intensity_prec) {
 
+    ProfileStageTimer timer(STAGE_POSTPROCESS);
     if (peaks.empty())
         return;
 
@@ -0,0 +1,127 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# SpectrumCache.cpp
+#
+# Description: 	On-disk cache of predicted spectra, keyed by structure
+#				and by the model and settings used for the prediction.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#include "SpectrumCache.h"
+#include "Version.h"
+
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+
+SpectrumCache::SpectrumCache(const std::string &a_cache_dir, const std::string &a_model_fingerprint)
+    : cache_dir(a_cache_dir), model_fingerprint(a_model_fingerprint) {}
+
+bool SpectrumCache::fetch(const std::string &key, std::vector<Spectrum> &spectra) const {
+
+	std::ifstream ifs(getEntryFilename(key).c_str());
+	if (!ifs.good()) return false;
+
+	// Check the entry really is for this key and model (guards against hash collisions)
+	std::string entry_key, entry_fingerprint, end_marker;
+	unsigned int num_spectra;
+	ifs >> entry_key >> entry_fingerprint >> num_spectra;
+	if (!ifs.good() || entry_key != key || entry_fingerprint != model_fingerprint) return false;
+
+	std::vector<Spectrum> entry_spectra(num_spectra);
+	for (auto &spectrum : entry_spectra) {
+		unsigned int num_peaks;
+		ifs >> num_peaks;
+		for (unsigned int i = 0; i < num_peaks && ifs.good(); i++) {
+			double mass, intensity;
+			ifs >> mass >> intensity;
+			spectrum.push_back(Peak(mass, intensity));
+		}
+	}
+	ifs >> end_marker;
+	if (ifs.fail() || end_marker != "END") return false;
+
+	spectra.swap(entry_spectra);
+	return true;
+}
+
+void SpectrumCache::store(const std::string &key, const std::vector<Spectrum> &spectra) const {
+
+	boost::filesystem::path entry_path(getEntryFilename(key));
+	boost::system::error_code ec;
+	boost::filesystem::create_directories(entry_path.parent_path(), ec);
+
+	// Write to a unique temporary file, then rename it into place (atomic on POSIX filesystems)
+	boost::filesystem::path tmp_path = entry_path;
+	tmp_path += boost::filesystem::unique_path(".%%%%-%%%%-%%%%-%%%%.tmp");
+	std::ofstream of(tmp_path.string().c_str());
+	if (!of.is_open()) {
+		std::cerr << "Warning: Could not write spectrum cache entry " << tmp_path.string() << std::endl;
+		return;
+	}
+
+	of << key << "\n" << model_fingerprint << "\n" << spectra.size() << "\n";
+	of << std::setprecision(17);
+	for (auto &spectrum : spectra) {
+		of << spectrum.size() << "\n";
+		for (auto &peak : spectrum) of << peak.mass << " " << peak.intensity << "\n";
+	}
+	of << "END\n";
+	of.close();
+
+	if (of.fail()) {
+		std::cerr << "Warning: Could not write spectrum cache entry " << tmp_path.string() << std::endl;
+		boost::filesystem::remove(tmp_path, ec);
+		return;
+	}
+	boost::filesystem::rename(tmp_path, entry_path, ec);
+	if (ec) boost::filesystem::remove(tmp_path, ec);
+}
+
+std::string SpectrumCache::computeModelFingerprint(const std::vector<std::string> &filenames,
+                                                   const std::string &settings) {
+
+	uint64_t fingerprint = hash(std::string(PROJECT_VER) + " " + settings);
+	for (auto &filename : filenames) {
+		std::ifstream ifs(filename.c_str(), std::ifstream::in | std::ifstream::binary);
+		std::stringstream contents;
+		contents << ifs.rdbuf();
+		fingerprint = hash(contents.str(), fingerprint);
+	}
+	return toHex(fingerprint);
+}
+
+uint64_t SpectrumCache::hash(const std::string &data, uint64_t seed) {
+
+	uint64_t value = seed;
+	for (unsigned char c : data) {
+		value ^= c;
+		value *= 1099511628211ULL;
+	}
+	return value;
+}
+
+std::string SpectrumCache::getEntryFilename(const std::string &key) const {
+
+	// Spread the entries over 256 subdirectories to keep directory sizes down
+	std::string key_hash = toHex(hash(key));
+	return cache_dir + "/" + model_fingerprint + "/" + key_hash.substr(0, 2) + "/" + key_hash + ".spec";
+}
+
+std::string SpectrumCache::toHex(uint64_t value) {
+
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << value;
+	return ss.str();
+}
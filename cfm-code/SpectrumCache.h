@@ -0,0 +1,62 @@
+/*#########################################################################
+# Mass Spec Prediction and Identification of Metabolites
+#
+# SpectrumCache.h
+#
+# Description: 	On-disk cache of predicted spectra, keyed by structure
+#				and by the model and settings used for the prediction.
+#
+# Copyright (c) 2013, Felicity Allen
+# All rights reserved.
+
+# This file is part of the cfm-id project.
+# The contents are covered by the terms of the GNU Lesser General Public
+# License, which is included in the file license.txt, found at the root
+# of the cfm source tree.
+#########################################################################*/
+
+#ifndef __SPECTRUM_CACHE_H__
+#define __SPECTRUM_CACHE_H__
+
+#include "Spectrum.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Persistent cache of predicted spectra. Entries are keyed by the canonical
+// smiles the fragment graph is built from, within a directory for the model
+// fingerprint (a hash of everything else that affects the prediction: the
+// parameter and config files and the prediction settings).
+//
+// Each entry is a file, written to a temporary name and then renamed into
+// place, so any number of threads and processes can share one cache: readers
+// only ever see complete entries, and concurrent writers of the same entry
+// just replace it with identical content.
+class SpectrumCache {
+public:
+    //Constructor
+    SpectrumCache(const std::string &a_cache_dir, const std::string &a_model_fingerprint);
+
+    //Fetch the spectra for a key, returns false if they aren't in the cache
+    bool fetch(const std::string &key, std::vector<Spectrum> &spectra) const;
+
+    //Add the spectra for a key to the cache (failures are reported, but not fatal)
+    void store(const std::string &key, const std::vector<Spectrum> &spectra) const;
+
+    //Fingerprint for the model files and a description of the settings used with them
+    static std::string computeModelFingerprint(const std::vector<std::string> &filenames, const std::string &settings);
+
+    //64 bit FNV-1a hash (stable across platforms and runs, unlike std::hash)
+    static uint64_t hash(const std::string &data, uint64_t seed = 14695981039346656037ULL);
+
+private:
+    std::string cache_dir;
+    std::string model_fingerprint;
+
+    std::string getEntryFilename(const std::string &key) const;
+
+    static std::string toHex(uint64_t value);
+};
+
+#endif // __SPECTRUM_CACHE_H__
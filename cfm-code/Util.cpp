@@ -153,8 +153,9 @@ void softmax(std::vector<double> &weights, std::vector<double> &probs) {
 
 void labelNitroGroup(const RDKit::ROMol *mol) {
 	// NOTE this is a context specific solution for nitro group single bond oxygen
-	auto fparams                      = new RDKit::FragCatParams(PI_BOND_FGRPS_PICKLE);
-	const RDKit::MOL_SPTR_VECT &fgrps = fparams->getFuncGroups();
+	// The pickle is parsed once and then shared (read only) by every call and thread
+	static const RDKit::FragCatParams fparams(PI_BOND_FGRPS_PICKLE);
+	const RDKit::MOL_SPTR_VECT &fgrps = fparams.getFuncGroups();
 	for (auto &fgrp : fgrps) {
 		std::string fg_name;
 		fgrp->getProp("_Name", fg_name);
@@ -174,7 +175,6 @@ void labelNitroGroup(const RDKit::ROMol *mol) {
 			}
 		}
 	}
-	delete fparams;
 }
 
 int getValence(const RDKit::Atom *atom) {
@@ -15,22 +15,56 @@
 # of the cfm source tree.
 #########################################################################*/
 
+#include "AsyncOutputWriter.h"
+#include "BatchManifest.h"
 #include "Config.h"
+#include "FragmentExpansionCache.h"
+#include "GraphMemoryBudget.h"
+#include "MILP.h"
 #include "MolData.h"
+#include "MolInputReader.h"
 #include "Param.h"
+#include "PredictionDeduplicator.h"
+#include "PredictionProfile.h"
+#include "SpectrumCache.h"
 #include "Version.h"
 #include "omp.h"
 
 #include <GraphMol/SanitException.h>
 #include <GraphMol/SmilesParse/SmilesParse.h>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/asio.hpp>
 #include <boost/filesystem.hpp>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <exception>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 int main(int argc, char *argv[]);
 
+// Bounds on the molecules held in memory during a batch run: those read ahead from
+// the input, and those predicted but waiting for an earlier molecule to be written
+static const size_t MAX_QUEUED_INPUT_MOLS         = 1024;
+static const size_t MAX_UNWRITTEN_MOLS_PER_THREAD = 64;
+
+// Most structures remembered for sharing predictions between duplicate inputs
+static const size_t MAX_DEDUPLICATED_STRUCTURES = 100000;
+
+// A finished molecule waiting for its turn to be written
+struct finished_mol_t {
+	MolData *mol_data;
+	bool predicted; // False if prediction failed, so there is nothing to write
+};
+
 class SpectrumPredictionException : public std::exception {
 private:
 	std::runtime_error message_;
@@ -57,7 +91,25 @@ public:
 	;
 };
 
-void parseInputFile(std::vector<MolData> &data, std::string &input_filename, config_t *cfg);
+void predictSpectra(MolData &mol_data, LikelyFragmentGraphGenerator &fgen, Param &model, config_t &cfg,
+                    int do_annotate, int min_peaks, int max_peaks, double postprocessing_energy,
+                    double min_peak_intensity, SpectrumCache *cache, GraphMemoryBudget *memory_budget = nullptr,
+                    PredictionDeduplicator *dedup = nullptr);
+
+void computeSpectra(MolData &mol_data, LikelyFragmentGraphGenerator &fgen, Param &model, config_t &cfg,
+                    int do_annotate, int min_peaks, int max_peaks, double postprocessing_energy,
+                    double min_peak_intensity, SpectrumCache *cache, const std::string &cache_key,
+                    GraphMemoryBudget *memory_budget);
+
+bool servePredictions(std::istream &in, std::ostream &out, int output_mode, LikelyFragmentGraphGenerator &fgen,
+                      Param &model, config_t &cfg, int do_annotate, int min_peaks, int max_peaks,
+                      double postprocessing_energy, double min_peak_intensity, SpectrumCache *cache);
+
+void writePredictedSpectra(MolData &mol_data, size_t mol_idx, int output_mode, std::ostringstream &out,
+                           AsyncOutputWriter &writer, bool to_stdout, bool batch_run, const std::string &output_dir_str,
+                           int do_annotate);
+
+manifest_entry_t createManifestEntry(size_t mol_idx, const std::string &id, const std::ostringstream &out);
 
 int main(int argc, char *argv[]) {
 	bool to_stdout            = true;
@@ -73,9 +125,14 @@ int main(int argc, char *argv[]) {
 	int max_peaks                    = -1;
 	double min_peak_intensity        = -1;
 	std::string single_prediction_id = "NullId";
+	int output_shard_size            = 0;
+	std::string spectrum_cache_dir;
+	std::string timing_filename;
+	std::string manifest_filename;
 
 	if (argc != 6 && argc != 2 && argc != 5 && argc != 3 && argc != 7 && argc != 8 && argc != 9 && argc != 10 &&
-	    argc != 11 && argc != 12 && argc != 13 && argc != 14) {
+	    argc != 11 && argc != 12 && argc != 13 && argc != 14 && argc != 15 && argc != 16 && argc != 17 &&
+	    argc != 18) {
 		std::cout << std::endl << std::endl;
 		std::cout << std::endl
 		          << "CFM-ID Version: " << PROJECT_VER << std::endl
@@ -87,7 +144,11 @@ int main(int argc, char *argv[]) {
 		std::cout << std::endl
 		          << "input_smiles_or_inchi_or_file:" << std::endl
 		          << "The smiles or inchi string of the structure whose spectra you want to predict, or a .txt file "
-		             "containing a list of <id smiles> pairs, one per line."
+		             "(or gzip compressed .txt.gz file) containing a list of <id smiles> pairs, one per line. "
+		             "Alternatively stdin or unix:<socket_path> to keep the model loaded and answer <id smiles> "
+		             "requests, one per line, from stdin or from connections to a Unix domain socket (until a #SHUTDOWN "
+		             "request). In this mode "
+		             "output_filename_or_dir gives the output format instead (msp (default), mgf or txt)."
 		          << std::endl;
 		std::cout << std::endl
 		          << "prob_thresh_for_prune (opt):" << std::endl
@@ -140,6 +201,27 @@ int main(int argc, char *argv[]) {
 		std::cout << std::endl
 		          << "prediction id (opt):" << std::endl
 		          << "id for predicted spectra, only used in single input mode" << std::endl;
+		std::cout << std::endl
+		          << "output_shard_size (opt):" << std::endl
+		          << "split the msp, mgf or txt output into files <name>.0.<ext>, <name>.1.<ext>, ... of at most this "
+		             "many molecules each (0 = no split (default)). Output files ending in .gz are gzip compressed."
+		          << std::endl;
+		std::cout << std::endl
+		          << "spectrum_cache_dir (opt):" << std::endl
+		          << "directory of a persistent cache of predicted spectra, which can be shared between runs and "
+		             "processes (not used when including annotations)"
+		          << std::endl;
+		std::cout << std::endl
+		          << "timing_filename (opt):" << std::endl
+		          << "file to write a per-molecule breakdown of prediction time by stage (and counts of fragments, "
+		             "transitions, MILP solves and fragment matches) to, as one JSON object per line"
+		          << std::endl;
+		std::cout << std::endl
+		          << "manifest_filename (opt):" << std::endl
+		          << "batch runs only: file recording the molecules completed so far. If the run is restarted with "
+		             "the same manifest, completed molecules are skipped and the output is continued from where they "
+		             "ended (not supported for stdout or gzip compressed output)"
+		          << std::endl;
 		exit(1);
 	}
 
@@ -186,7 +268,7 @@ int main(int argc, char *argv[]) {
 			postprocessing_energy = 80;
 		}
 	}
-	if (argc == 9) {
+	if (argc >= 9) {
 		try {
 			suppress_exceptions = boost::lexical_cast<bool>(argv[8]);
 		} catch (boost::bad_lexical_cast &e) {
@@ -194,7 +276,7 @@ int main(int argc, char *argv[]) {
 			exit(1);
 		}
 	}
-	if (argc == 10) {
+	if (argc >= 10) {
 		try {
 			postprocessing_energy = boost::lexical_cast<double>(argv[9]);
 		} catch (boost::bad_lexical_cast &e) {
@@ -203,7 +285,7 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (argc == 11) {
+	if (argc >= 11) {
 		try {
 			auto input_min_peak_intensity = boost::lexical_cast<double>(argv[10]);
 			if (input_min_peak_intensity >= 0) min_peak_intensity = input_min_peak_intensity;
@@ -213,7 +295,7 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (argc == 12) {
+	if (argc >= 12) {
 		try {
 			auto input_min_peaks = boost::lexical_cast<int>(argv[11]);
 			if (input_min_peaks >= 0) min_peaks = input_min_peaks;
@@ -223,7 +305,7 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (argc == 13) {
+	if (argc >= 13) {
 		try {
 			auto input_max_peaks = boost::lexical_cast<int>(argv[12]);
 			if (input_max_peaks >= 0) max_peaks = input_max_peaks;
@@ -233,7 +315,22 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	if (argc == 14) { single_prediction_id = argv[13]; }
+	if (argc >= 14) { single_prediction_id = argv[13]; }
+
+	if (argc >= 15) {
+		try {
+			output_shard_size = boost::lexical_cast<int>(argv[14]);
+		} catch (boost::bad_lexical_cast &e) {
+			std::cout << "Invalid output_shard_size: " << argv[14] << std::endl;
+			exit(1);
+		}
+	}
+
+	if (argc >= 16) { spectrum_cache_dir = argv[15]; }
+
+	if (argc >= 17) { timing_filename = argv[16]; }
+
+	if (argc >= 18) { manifest_filename = argv[17]; }
 
 	// Initialise model configuration
 	config_t cfg;
@@ -258,56 +355,97 @@ int main(int argc, char *argv[]) {
 		exit(1);
 	}
 
-	Param *param;
-	NNParam *nn_param;
+	Param *param      = nullptr;
+	NNParam *nn_param = nullptr;
 	if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION)
 		nn_param = new NNParam(param_filename);
 	else
 		param = new Param(param_filename);
 
-	// Check for mgf or msp output - and setup in exists
-	int output_mode = NO_OUTPUT_MODE;
-	std::ostream *out;
-	std::ofstream of;
-	std::streambuf *buf;
-	if (!to_stdout && output_filename.substr(output_filename.size() - 4) == ".msp") {
-		output_mode = MSP_OUTPUT_MODE;
-		of.open(output_filename.c_str());
-		if (!of.is_open()) {
-			std::cerr << "Error: Could not open output msp file " << output_filename << std::endl;
-			if (!suppress_exceptions) throw FileException("Could not open output msp file " + output_filename);
+	// Set up the spectrum cache (if selected), for everything that affects the predictions
+	SpectrumCache *cache = nullptr;
+	if (!spectrum_cache_dir.empty()) {
+		// (at full precision, so runs with any different setting don't share entries)
+		std::stringstream settings;
+		settings << std::setprecision(17) << prob_thresh_for_prune << " " << min_peaks << " " << max_peaks << " " << postprocessing_energy << " "
+		         << min_peak_intensity;
+		cache = new SpectrumCache(spectrum_cache_dir, SpectrumCache::computeModelFingerprint(
+		                                                  {param_filename, config_filename}, settings.str()));
+	}
+
+	// Server mode - keep the model loaded and answer requests until the input closes
+	if (input_smiles_or_inchi == "stdin" || input_smiles_or_inchi.substr(0, 5) == "unix:") {
+		int server_output_mode = MSP_OUTPUT_MODE;
+		if (output_filename == "mgf")
+			server_output_mode = MGF_OUTPUT_MODE;
+		else if (output_filename == "txt")
+			server_output_mode = SINGLE_TXT_OUTPUT_MODE;
+
+		LikelyFragmentGraphGenerator *fgen;
+		if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION)
+			fgen = new LikelyFragmentGraphGenerator(nn_param, &cfg, prob_thresh_for_prune);
+		else
+			fgen = new LikelyFragmentGraphGenerator(param, &cfg, prob_thresh_for_prune);
+		Param &model = nn_param != nullptr ? *nn_param : *param;
+
+		if (input_smiles_or_inchi == "stdin") {
+			// stdout carries the responses, so send anything else written to std::cout to stderr
+			std::ostream response_out(std::cout.rdbuf());
+			std::cout.rdbuf(std::cerr.rdbuf());
+			servePredictions(std::cin, response_out, server_output_mode, *fgen, model, cfg, do_annotate, min_peaks,
+			                 max_peaks, postprocessing_energy, min_peak_intensity, cache);
+			std::cout.rdbuf(response_out.rdbuf());
+		} else {
+			std::string socket_path = input_smiles_or_inchi.substr(5);
+			boost::filesystem::remove(socket_path);
+			boost::asio::io_context io_context;
+			boost::asio::local::stream_protocol::acceptor acceptor(
+			    io_context, boost::asio::local::stream_protocol::endpoint(socket_path));
+			std::cout << "Listening for prediction requests on " << socket_path << std::endl;
+
+			// Connections are served one at a time, each for as long as the client keeps it open
+			bool shutdown = false;
+			while (!shutdown) {
+				boost::asio::local::stream_protocol::iostream stream;
+				boost::system::error_code ec;
+				acceptor.accept(stream.socket(), ec);
+				if (ec) {
+					std::cerr << "Error: Could not accept connection: " << ec.message() << std::endl;
+					continue;
+				}
+				shutdown = servePredictions(stream, stream, server_output_mode, *fgen, model, cfg, do_annotate,
+				                            min_peaks, max_peaks, postprocessing_energy, min_peak_intensity, cache);
+			}
+			boost::filesystem::remove(socket_path);
 		}
-		buf = of.rdbuf();
-		out = new std::ostream(buf);
-	} else if (!to_stdout && output_filename.substr(output_filename.size() - 4) == ".mgf") {
+		delete fgen;
+		delete cache;
+		return (0);
+	}
+
+	// Check for mgf or msp output (possibly gzip compressed)
+	int output_mode             = NO_OUTPUT_MODE;
+	std::string output_basename = output_filename;
+	if (boost::algorithm::ends_with(output_basename, ".gz"))
+		output_basename = output_basename.substr(0, output_basename.size() - 3);
+	if (!to_stdout && boost::algorithm::ends_with(output_basename, ".msp"))
+		output_mode = MSP_OUTPUT_MODE;
+	else if (!to_stdout && boost::algorithm::ends_with(output_basename, ".mgf"))
 		output_mode = MGF_OUTPUT_MODE;
-		of.open(output_filename.c_str());
-		if (!of.is_open()) {
-			std::cerr << "Error: Could not open output mgf file " << output_filename << std::endl;
-			if (!suppress_exceptions) throw FileException("Could not open output mgf file " + output_filename);
-		}
-		buf = of.rdbuf();
-		out = new std::ostream(buf);
-	} else if (!to_stdout && (output_filename.substr(output_filename.size() - 4) == ".txt" ||
-	                          output_filename.substr(output_filename.size() - 4) == ".log")) {
+	else if (!to_stdout && (boost::algorithm::ends_with(output_basename, ".txt") ||
+	                        boost::algorithm::ends_with(output_basename, ".log")))
 		output_mode = SINGLE_TXT_OUTPUT_MODE;
-		of.open(output_filename.c_str());
-		if (!of.is_open()) {
-			std::cerr << "Error: Could not open output txt/log file " << output_filename << std::endl;
-			if (!suppress_exceptions) throw FileException("Could not open output txt/log file " + output_filename);
-		}
-		buf = of.rdbuf();
-		out = new std::ostream(buf);
-	}
-	// Check for batch input - if found, read in inchis and set up output directory, mgf or msp
-	std::vector<MolData> data;
-	bool batch_run = false;
+
+	// Check for batch input - if found, stream in the molecules and set up output directory, mgf or msp
+	MolInputReader *input = nullptr;
+	bool batch_run        = false;
 	std::string output_dir_str;
-	if (input_smiles_or_inchi.size() > 4 && input_smiles_or_inchi.substr(input_smiles_or_inchi.size() - 4) == ".txt") {
+	if (boost::algorithm::ends_with(input_smiles_or_inchi, ".txt") ||
+	    boost::algorithm::ends_with(input_smiles_or_inchi, ".txt.gz")) {
 
 		try {
-			parseInputFile(data, input_smiles_or_inchi, &cfg);
-		} catch (FileException &e) {
+			input = new MolInputReader(input_smiles_or_inchi, MAX_QUEUED_INPUT_MOLS);
+		} catch (MolInputReadException &e) {
 			if (!suppress_exceptions) throw FileException("Could not parse input file " + input_smiles_or_inchi);
 			exit(1);
 		}
@@ -317,139 +455,404 @@ int main(int argc, char *argv[]) {
 				boost::filesystem::create_directory(output_filename);
 			output_dir_str = output_filename + "/";
 		}
-		if (!to_stdout) std::cout << "Read " << data.size() << " molecules from input file." << std::endl;
-	} else {
-		data.push_back(MolData(single_prediction_id.c_str(), input_smiles_or_inchi.c_str(), &cfg));
 	}
 
-	// #pragma omp parallel for num_threads(NUMBER_OF_THREADS) schedule(static)
-	for (size_t mol_idx = 0; mol_idx < data.size(); ++mol_idx) {
-		// std::cout << "Predicting spectra for " << data[mol_idx].getId() << " " << data[mol_idx].getSmilesOrInchi()
-		// << std::endl;
-		auto mol_data = data[mol_idx];
-		// Create the MolData structure with the input
+	// Read the manifest of molecules completed by an earlier run (if resuming)
+	BatchManifest *manifest = nullptr;
+	if (!manifest_filename.empty()) {
+		if (!batch_run || to_stdout || boost::algorithm::ends_with(output_filename, ".gz")) {
+			std::cerr << "Error: A manifest can only be used for batch runs with uncompressed output files" << std::endl;
+			exit(1);
+		}
 		try {
-			// Calculate the pruned FragmentGraph
-			LikelyFragmentGraphGenerator *fgen;
-			if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION)
-				fgen = new LikelyFragmentGraphGenerator(nn_param, &cfg, prob_thresh_for_prune);
-			else
-				fgen = new LikelyFragmentGraphGenerator(param, &cfg, prob_thresh_for_prune);
-
-			mol_data.computeLikelyFragmentGraphAndSetThetas(*fgen, do_annotate);
-
-			mol_data.computePredictedSpectra(*nn_param, true, -1, min_peaks, max_peaks, postprocessing_energy,
-			                                 min_peak_intensity, cfg.default_mz_decimal_place, cfg.use_log_scale_peak);
-			// Predict the spectra (and post-process, use existing thetas)
-		} catch (RDKit::MolSanitizeException &e) {
-			std::cerr << "Could not sanitize input: " << mol_data.getId() << " " << mol_data.getSmilesOrInchi()
-			          << std::endl;
-
-			// we print the error message to the console
-			std::cerr << e.what() << std::endl;
-			std::cout << e.getType() << std::endl;
-			if (!batch_run && !suppress_exceptions)
-				throw SpectrumPredictionException("RDKit could not sanitize input: " + mol_data.getSmilesOrInchi());
-			continue;
-		} catch (RDKit::SmilesParseException &pe) {
-			std::cerr << "Could not parse input: " << mol_data.getId() << " " << mol_data.getSmilesOrInchi()
-			          << std::endl;
-			std::cerr << pe.what() << std::endl;
-			if (!batch_run && !suppress_exceptions)
-				throw SpectrumPredictionException("RDKit could not parse input: " + mol_data.getSmilesOrInchi());
-			continue;
-		} catch (FragmentGraphGenerationException &ge) {
-			std::cerr << "Could not compute fragmentation graph for input: " << mol_data.getId() << " "
-			          << mol_data.getSmilesOrInchi() << std::endl;
-			if (!batch_run && !suppress_exceptions)
-				throw SpectrumPredictionException("Could not compute fragmentation graph for input: " +
-				                                  mol_data.getSmilesOrInchi());
-			continue;
+			manifest = new BatchManifest(manifest_filename);
+		} catch (ManifestOpenException &e) {
+			if (!suppress_exceptions) throw FileException("Could not open manifest file " + manifest_filename);
+			exit(1);
 		}
+	}
 
-		catch (IonizationException &ie) {
-			std::cerr << "Could not ionize: " << mol_data.getId() << " " << mol_data.getSmilesOrInchi() << std::endl;
-			if (!batch_run && !suppress_exceptions) throw IonizationException();
-			continue;
-		} catch (FragmentGraphTimeoutException &te) {
-			std::cerr << "Timeout computing fragmentation graph for input: " << mol_data.getId() << " "
-			          << mol_data.getSmilesOrInchi() << std::endl;
-		} catch (std::runtime_error &e) {
-			// whatever else can go wrong
-			std::cerr << e.what() << std::endl;
-			if (!batch_run && !suppress_exceptions) throw std::runtime_error(e.what());
-			continue;
+	// All writing is done by a background writer (whose main output is unused when
+	// a batch run writes one file per molecule). It separates the molecules of a
+	// single txt file, so each shard starts with a molecule.
+	AsyncOutputWriter *writer;
+	std::string writer_filename = output_filename;
+	if (to_stdout || (batch_run && output_mode == NO_OUTPUT_MODE)) writer_filename = "";
+	std::string record_separator = output_mode == SINGLE_TXT_OUTPUT_MODE ? "\n\n" : "";
+	try {
+		writer = new AsyncOutputWriter(writer_filename, output_shard_size, 256, manifest, record_separator);
+	} catch (OutputWriteException &e) {
+		std::cerr << "Error: Could not open output file " << output_filename << std::endl;
+		if (!suppress_exceptions) throw FileException("Could not open output file " + output_filename);
+		exit(1);
+	}
+	AsyncOutputWriter *timing_writer = nullptr;
+	if (!timing_filename.empty()) {
+		try {
+			timing_writer = new AsyncOutputWriter(timing_filename);
+		} catch (OutputWriteException &e) {
+			std::cerr << "Error: Could not open timing file " << timing_filename << std::endl;
+			if (!suppress_exceptions) throw FileException("Could not open timing file " + timing_filename);
+			exit(1);
 		}
+	}
 
-		// Set up the output stream (if not already set up)
-		if (output_mode == NO_OUTPUT_MODE) {
-			if (!to_stdout) {
-				if (batch_run) output_filename = output_dir_str + mol_data.getId() + ".log";
-				of.open(output_filename.c_str());
-				if (!of.is_open()) {
-					std::cerr << "Error: Could not open output file " << output_filename << std::endl;
-					if (!batch_run && !suppress_exceptions)
-						throw FileException("Could not open output file " + output_filename);
-				}
-				buf = of.rdbuf();
-			} else
-				buf = std::cout.rdbuf();
-			out = new std::ostream(buf);
+	// Each worker thread owns a generator (and with it a FeatureCalculator and
+	// FeatureHelper), reused for all the molecules it predicts, so no fragmentation
+	// state is shared between threads.
+	int num_threads = batch_run ? NUMBER_OF_THREADS : 1;
+	LikelyFragmentGraphGeneratorPool *fgen_pool;
+	if (cfg.theta_function == NEURAL_NET_THETA_FUNCTION)
+		fgen_pool = new LikelyFragmentGraphGeneratorPool(nn_param, &cfg, prob_thresh_for_prune, num_threads);
+	else
+		fgen_pool = new LikelyFragmentGraphGeneratorPool(param, &cfg, prob_thresh_for_prune, num_threads);
+
+	Param &model = nn_param != nullptr ? *nn_param : *param;
+
+	// Keep the fragment graphs being computed at once within the configured memory budget
+	GraphMemoryBudget *memory_budget = nullptr;
+	if (cfg.graph_memory_budget_mb > 0)
+		memory_budget = new GraphMemoryBudget((size_t)(cfg.graph_memory_budget_mb * 1024 * 1024));
+
+	// Predict each structure in the input once (annotations come from each molecule's own graph)
+	PredictionDeduplicator *dedup = nullptr;
+	if (batch_run && cfg.deduplicate_inputs && !do_annotate)
+		dedup = new PredictionDeduplicator(MAX_DEDUPLICATED_STRUCTURES);
+
+	// Molecules may finish out of order, so predictions are held here until every
+	// molecule before them has been written. This keeps the output identical to a
+	// serial run (including the formatting state carried by a shared output stream).
+	std::map<size_t, finished_mol_t> pending;
+	std::ostringstream render_out;
+
+	// Skip the molecules completed by an earlier run, and continue from the state they left the output in
+	size_t num_completed = manifest != nullptr ? manifest->getNumCompleted() : 0;
+	if (num_completed > 0) {
+		const manifest_entry_t *last_entry = manifest->getLastEntry();
+		mol_input_t mol;
+		bool found = true;
+		try {
+			for (size_t i = 0; i < num_completed && found; i++) found = input->next(mol);
+		} catch (std::exception &e) {
+			std::cerr << "Error: " << e.what() << std::endl;
+			exit(1);
 		}
-
-		// Write the spectra to output
-		if (output_mode == NO_OUTPUT_MODE || output_mode == SINGLE_TXT_OUTPUT_MODE) {
-			if (output_mode == SINGLE_TXT_OUTPUT_MODE && mol_idx > 0) *out << std::endl << std::endl;
-			mol_data.outputSpectra(*out, "Predicted", do_annotate);
-
-			// if (do_annotate){
-			//*out << std::endl;
-			// mol_data.writeFragmentsOnly(*out);
-			// }
-
-		} else if (output_mode == MSP_OUTPUT_MODE) {
-			std::cout << "[DEBUG] writing to msp" << std::endl;
-			mol_data.writePredictedSpectraToMspFileStream(*out);
-		} else if (output_mode == MGF_OUTPUT_MODE) {
-			std::cout << "[DEBUG] writing to mgf" << std::endl;
-			mol_data.writePredictedSpectraToMgfFileStream(*out);
+		if (!found || mol.id != last_entry->id) {
+			std::cerr << "Error: Input doesn't match manifest " << manifest_filename << " (expected molecule "
+			          << num_completed << " to be " << last_entry->id << ")" << std::endl;
+			exit(1);
 		}
+		render_out.flags((std::ios_base::fmtflags)last_entry->format_flags);
+		render_out.precision(last_entry->precision);
+		std::cout << "Resuming after " << num_completed << " completed molecules" << std::endl;
+	}
+	std::atomic<size_t> next_to_write(num_completed);
+	std::mutex write_progress_mutex;
+	std::condition_variable write_progress;
+	size_t max_unwritten = MAX_UNWRITTEN_MOLS_PER_THREAD * num_threads;
+	bool single_mol_taken = false;
+	std::exception_ptr failure;
+	std::atomic<bool> input_failed(false);
+
+#pragma omp parallel num_threads(num_threads)
+	{
+		mol_input_t mol;
+		while (true) {
+			if (batch_run) {
+				// Every thread sees a failure to read the input, so only the first reports it
+				try {
+					if (!input->next(mol)) break;
+				} catch (std::exception &e) {
+					if (!input_failed.exchange(true)) std::cerr << "Error: " << e.what() << std::endl;
+					break;
+				} catch (...) {
+					if (!input_failed.exchange(true)) std::cerr << "Error: Could not read input file" << std::endl;
+					break;
+				}
+			} else {
+				if (single_mol_taken) break;
+				mol.id              = single_prediction_id;
+				mol.smiles_or_inchi = input_smiles_or_inchi;
+				mol.input_idx       = 0;
+				single_mol_taken    = true;
+			}
+			size_t mol_idx = mol.input_idx;
+
+			// Don't run too far ahead of the output, e.g. while an earlier molecule is slow to finish
+			{
+				std::unique_lock<std::mutex> lock(write_progress_mutex);
+				write_progress.wait(lock, [&] { return mol_idx < next_to_write + max_unwritten; });
+			}
+
+			// Profile the stages of this prediction, if timings were requested
+			PredictionProfile profile;
+			if (timing_writer != nullptr) PredictionProfile::setActive(&profile);
+			auto start_time    = std::chrono::steady_clock::now();
+			std::string status = "error";
+
+			auto *mol_data = new MolData(mol.id.c_str(), mol.smiles_or_inchi.c_str(), &cfg);
+			bool to_write  = false;
+			try {
+				predictSpectra(*mol_data, fgen_pool->getGenerator(), model, cfg, do_annotate, min_peaks, max_peaks,
+				               postprocessing_energy, min_peak_intensity, cache, memory_budget, dedup);
+				to_write = true;
+				status   = "ok";
+			} catch (RDKit::MolSanitizeException &e) {
+				std::cerr << "Could not sanitize input: " << mol_data->getId() << " " << mol_data->getSmilesOrInchi()
+				          << std::endl;
+
+				// we print the error message to the console
+				std::cerr << e.what() << std::endl;
+				std::cout << e.getType() << std::endl;
+				if (!batch_run && !suppress_exceptions)
+					failure = std::make_exception_ptr(
+					    SpectrumPredictionException("RDKit could not sanitize input: " + mol_data->getSmilesOrInchi()));
+			} catch (RDKit::SmilesParseException &pe) {
+				std::cerr << "Could not parse input: " << mol_data->getId() << " " << mol_data->getSmilesOrInchi()
+				          << std::endl;
+				std::cerr << pe.what() << std::endl;
+				if (!batch_run && !suppress_exceptions)
+					failure = std::make_exception_ptr(
+					    SpectrumPredictionException("RDKit could not parse input: " + mol_data->getSmilesOrInchi()));
+			} catch (FragmentGraphGenerationException &ge) {
+				std::cerr << "Could not compute fragmentation graph for input: " << mol_data->getId() << " "
+				          << mol_data->getSmilesOrInchi() << std::endl;
+				if (!batch_run && !suppress_exceptions)
+					failure = std::make_exception_ptr(SpectrumPredictionException(
+					    "Could not compute fragmentation graph for input: " + mol_data->getSmilesOrInchi()));
+			} catch (IonizationException &ie) {
+				std::cerr << "Could not ionize: " << mol_data->getId() << " " << mol_data->getSmilesOrInchi()
+				          << std::endl;
+				if (!batch_run && !suppress_exceptions) failure = std::make_exception_ptr(IonizationException());
+			} catch (FragmentGraphTimeoutException &te) {
+				std::cerr << "Timeout computing fragmentation graph for input: " << mol_data->getId() << " "
+				          << mol_data->getSmilesOrInchi() << std::endl;
+				to_write = true;
+				status   = "timeout";
+			} catch (RingPerceptionMismatchException &re) {
+				std::cerr << "Ring perception mismatch for input: " << mol_data->getId() << " "
+				          << mol_data->getSmilesOrInchi() << std::endl;
+				std::cerr << re.what() << std::endl;
+				if (!batch_run && !suppress_exceptions)
+					failure = std::make_exception_ptr(std::runtime_error(re.what()));
+			} catch (std::runtime_error &e) {
+				// whatever else can go wrong
+				std::cerr << e.what() << std::endl;
+				if (!batch_run && !suppress_exceptions)
+					failure = std::make_exception_ptr(std::runtime_error(e.what()));
+			}
+
+			if (timing_writer != nullptr) {
+				PredictionProfile::setActive(nullptr);
+				std::chrono::duration<double> total_time = std::chrono::steady_clock::now() - start_time;
+				std::ostringstream timing_out;
+				profile.writeJsonLine(timing_out, mol.id, status, total_time.count());
+				timing_writer->write(timing_out.str());
+			}
+
+			// Write out every prediction that is now next in input order
+#pragma omp critical(write_predictions)
+			{
+				pending[mol_idx]          = finished_mol_t{mol_data, to_write};
+				size_t prev_next_to_write = next_to_write;
+				auto it                   = pending.begin();
+				while (it != pending.end() && it->first == next_to_write) {
+					if (it->second.predicted)
+						writePredictedSpectra(*it->second.mol_data, it->first, output_mode, render_out, *writer,
+						                      to_stdout, batch_run, output_dir_str, do_annotate);
+					else
+						writer->skip(createManifestEntry(it->first, it->second.mol_data->getId(), render_out));
+					delete it->second.mol_data;
+					it = pending.erase(it);
+					++next_to_write;
+				}
 
-		if (output_mode == NO_OUTPUT_MODE) {
-			if (!to_stdout) of.close();
-			delete out;
+				// Wake any threads waiting for the output to catch up (under the lock, so none can
+				// miss the advance between checking it and starting to wait)
+				if (next_to_write != prev_next_to_write) {
+					std::lock_guard<std::mutex> lock(write_progress_mutex);
+					write_progress.notify_all();
+				}
+			}
 		}
+	}
+
+	if (batch_run && MILPSolutionCache::getNumHits() + MILPSolutionCache::getNumMisses() > 0)
+		std::cerr << "MILP solution cache: " << MILPSolutionCache::getNumHits() << " hits, "
+		          << MILPSolutionCache::getNumMisses() << " misses" << std::endl;
+	if (batch_run && FragmentExpansionCache::getNumHits() + FragmentExpansionCache::getNumMisses() > 0)
+		std::cerr << "Fragment expansion cache: " << FragmentExpansionCache::getNumHits() << " hits, "
+		          << FragmentExpansionCache::getNumMisses() << " misses" << std::endl;
+	if (dedup != nullptr && dedup->getNumShared() > 0)
+		std::cerr << "Duplicate structures: " << dedup->getNumShared() << " inputs given an earlier prediction"
+		          << std::endl;
 
-		if (!to_stdout)
-			std::cout << "(" << mol_idx + 1 << "/" << data.size() << ") Predicted Spectra for " << mol_data.getId()
-			          << " " << mol_data.getSmilesOrInchi() << std::endl;
+	delete input;
+	delete dedup;
+	delete fgen_pool;
+	delete memory_budget;
+	delete writer;
+	delete manifest;
+	delete timing_writer;
+	delete cache;
+	if (input_failed) {
+		std::cerr << "Error: Stopped before the end of input file " << input_smiles_or_inchi
+		          << ", the molecules after those written were not predicted" << std::endl;
+		return (1);
 	}
-	if (output_mode != NO_OUTPUT_MODE) delete out;
+	if (failure) std::rethrow_exception(failure);
 	return (0);
 }
 
-void parseInputFile(std::vector<MolData> &data, std::string &input_filename, config_t *cfg) {
+void predictSpectra(MolData &mol_data, LikelyFragmentGraphGenerator &fgen, Param &model, config_t &cfg,
+                    int do_annotate, int min_peaks, int max_peaks, double postprocessing_energy,
+                    double min_peak_intensity, SpectrumCache *cache, GraphMemoryBudget *memory_budget,
+                    PredictionDeduplicator *dedup) {
+
+	// The structure the fragment graph is built from, which both the deduplicator and the spectrum
+	// cache key on (annotations need the fragment graph, so are never shared or served from the cache)
+	std::string structure_smiles;
+	if ((dedup != nullptr || cache != nullptr) && !do_annotate)
+		structure_smiles = FragmentGraphGenerator::getCanonicalNonStereoSmiles(mol_data.getSmilesOrInchi());
+
+	// Use the spectra of an earlier input with the same structure, if there was one
+	PredictionDeduplicator::claim_t claim;
+	if (dedup != nullptr && !do_annotate) {
+		std::vector<Spectrum> shared_spectra;
+		claim = dedup->claimOrFetch(structure_smiles, shared_spectra);
+		if (!claim) {
+			mol_data.setPredictedSpectra(shared_spectra);
+			return;
+		}
+	}
 
-	std::string line, smiles_or_inchi, id;
-	std::ifstream ifs(input_filename.c_str(), std::ifstream::in);
+	// Whatever happens is passed on to any later inputs with the structure
+	try {
+		computeSpectra(mol_data, fgen, model, cfg, do_annotate, min_peaks, max_peaks, postprocessing_energy,
+		               min_peak_intensity, cache, cache != nullptr ? structure_smiles : "", memory_budget);
+	} catch (...) {
+		if (claim) claim->set_exception(std::current_exception());
+		throw;
+	}
+	if (claim) claim->set_value(*mol_data.getPredictedSpectra());
+}
 
-	// Get the first line - the number of input molecules
-	if (!ifs.good()) {
-		std::cout << "Could not open input file: " << input_filename << std::endl;
-		throw FileException("Could not open input file: " + input_filename);
+void computeSpectra(MolData &mol_data, LikelyFragmentGraphGenerator &fgen, Param &model, config_t &cfg,
+                    int do_annotate, int min_peaks, int max_peaks, double postprocessing_energy,
+                    double min_peak_intensity, SpectrumCache *cache, const std::string &cache_key,
+                    GraphMemoryBudget *memory_budget) {
+
+	// Use previously predicted spectra if they are cached (there is no key if they shouldn't be)
+	if (!cache_key.empty()) {
+		std::vector<Spectrum> cached_spectra;
+		if (cache->fetch(cache_key, cached_spectra)) {
+			mol_data.setPredictedSpectra(cached_spectra);
+			return;
+		}
 	}
 
-	// Now get all the molecules
-	int i = 0;
-	while (ifs.good()) {
-		i++;
+	// Calculate the pruned FragmentGraph, once there is room for it in the memory budget
+	GraphMemoryReservation reservation(memory_budget,
+	                                   GraphMemoryBudget::estimateGraphBytes(mol_data.getSmilesOrInchi()));
+	mol_data.computeLikelyFragmentGraphAndSetThetas(fgen, do_annotate);
+	reservation.resize(GraphMemoryBudget::measureGraphBytes(*mol_data.getFragmentGraph()));
+
+	// Predict the spectra (and post-process, use existing thetas)
+	mol_data.computePredictedSpectra(model, true, -1, min_peaks, max_peaks, postprocessing_energy, min_peak_intensity,
+	                                 cfg.default_mz_decimal_place, cfg.use_log_scale_peak);
+
+	// Only annotations need the graph once the spectra are predicted, so don't hold on to
+	// it (outside the budget) while the molecule waits to be written
+	if (!do_annotate) mol_data.freeFragmentGraph();
+	reservation.release();
 
-		getline(ifs, line);
-		if (line.size() < 3) continue;
+	if (!cache_key.empty()) cache->store(cache_key, *mol_data.getPredictedSpectra());
+}
+
+bool servePredictions(std::istream &in, std::ostream &out, int output_mode, LikelyFragmentGraphGenerator &fgen,
+                      Param &model, config_t &cfg, int do_annotate, int min_peaks, int max_peaks,
+                      double postprocessing_energy, double min_peak_intensity, SpectrumCache *cache) {
+
+	// Each request is a line "<id> <smiles_or_inchi>" (or just "<smiles_or_inchi>"). Each response is
+	// the predicted spectra in the requested format, or a line "#ERROR <id> <message>", followed by
+	// a line "#END <id>". A timeout gives whatever was predicted, as in a batch run. A line "#SHUTDOWN"
+	// stops the server, for which true is returned.
+	std::string line;
+	while (getline(in, line)) {
+		if (line == "#SHUTDOWN") return true;
 
+		std::string id, smiles_or_inchi;
 		std::stringstream ss(line);
 		ss >> id >> smiles_or_inchi;
+		if (id.empty()) continue;
+		if (smiles_or_inchi.empty()) {
+			smiles_or_inchi = id;
+			id              = "NullId";
+		}
+
+		MolData mol_data(id.c_str(), smiles_or_inchi.c_str(), &cfg);
+		try {
+			try {
+				predictSpectra(mol_data, fgen, model, cfg, do_annotate, min_peaks, max_peaks, postprocessing_energy,
+				               min_peak_intensity, cache);
+			} catch (FragmentGraphTimeoutException &te) {
+				std::cerr << "Timeout computing fragmentation graph for input: " << id << " " << smiles_or_inchi
+				          << std::endl;
+			}
+			if (output_mode == MGF_OUTPUT_MODE)
+				mol_data.writePredictedSpectraToMgfFileStream(out);
+			else if (output_mode == SINGLE_TXT_OUTPUT_MODE)
+				mol_data.outputSpectra(out, "Predicted", do_annotate);
+			else
+				mol_data.writePredictedSpectraToMspFileStream(out);
+		} catch (std::exception &e) {
+			std::cerr << "Could not predict spectra for input: " << id << " " << smiles_or_inchi << std::endl;
+			out << "#ERROR " << id << " " << e.what() << std::endl;
+		}
+		out << "#END " << id << std::endl;
+	}
+	return false;
+}
 
-		data.push_back(MolData(id.c_str(), smiles_or_inchi.c_str(), cfg));
+void writePredictedSpectra(MolData &mol_data, size_t mol_idx, int output_mode, std::ostringstream &out,
+                           AsyncOutputWriter &writer, bool to_stdout, bool batch_run, const std::string &output_dir_str,
+                           int do_annotate) {
+
+	// Render the spectra and hand them to the writer
+	if (output_mode == NO_OUTPUT_MODE) {
+		// A fresh stream for each molecule, written to its own file in a batch run
+		std::ostringstream mol_out;
+		mol_data.outputSpectra(mol_out, "Predicted", do_annotate);
+		if (batch_run && !to_stdout)
+			writer.writeToFile(output_dir_str + mol_data.getId() + ".log", mol_out.str(),
+			                   createManifestEntry(mol_idx, mol_data.getId(), out));
+		else
+			writer.write(mol_out.str(), createManifestEntry(mol_idx, mol_data.getId(), out));
+	} else {
+		// One stream for all molecules, so formatting state carries over between
+		// them just as it would when writing straight to a single output file
+		if (output_mode == SINGLE_TXT_OUTPUT_MODE)
+			mol_data.outputSpectra(out, "Predicted", do_annotate);
+		else if (output_mode == MSP_OUTPUT_MODE)
+			mol_data.writePredictedSpectraToMspFileStream(out);
+		else if (output_mode == MGF_OUTPUT_MODE)
+			mol_data.writePredictedSpectraToMgfFileStream(out);
+		writer.write(out.str(), createManifestEntry(mol_idx, mol_data.getId(), out));
+		out.str("");
 	}
+
+	if (!to_stdout)
+		std::cout << "(" << mol_idx + 1 << ") Predicted Spectra for " << mol_data.getId() << " "
+		          << mol_data.getSmilesOrInchi() << std::endl;
+}
+
+manifest_entry_t createManifestEntry(size_t mol_idx, const std::string &id, const std::ostringstream &out) {
+
+	// The writer fills in where the output stands
+	manifest_entry_t entry;
+	entry.input_idx    = mol_idx;
+	entry.id           = id;
+	entry.format_flags = out.flags();
+	entry.precision    = out.precision();
+	return entry;
 }
@@ -19,6 +19,7 @@
 #include "Config.h"
 #include "EmModel.h"
 #include "EmNNModel.h"
+#include "GraphMemoryBudget.h"
 #include "omp.h"
 #include <boost/filesystem.hpp>
 #include <boost/lexical_cast.hpp>
@@ -157,6 +158,14 @@ int main(int argc, char *argv[]) {
 	std::cout << "Computing fragmentation graphs and features using " << NUMBER_OF_THREADS << " threads..."
 	          << std::endl;
 
+	// Keep the graphs being computed at once within the configured memory budget (graphs loaded
+	// from file are already complete, and don't need the working space). Training keeps every
+	// graph for the whole run, so this only throttles construction: each reservation ends once
+	// its graph is built, and the finished graphs are not counted against the budget.
+	GraphMemoryBudget *memory_budget = nullptr;
+	if (cfg.graph_memory_budget_mb > 0)
+		memory_budget = new GraphMemoryBudget((size_t)(cfg.graph_memory_budget_mb * 1024 * 1024));
+
 	int success_count = 0, except_count = 0;
 #pragma omp parallel for reduction(+ : success_count, except_count) num_threads(NUMBER_OF_THREADS)
 	for (int i = 0; i < data.size(); ++i) {
@@ -179,6 +188,8 @@ int main(int argc, char *argv[]) {
 					eout << " Num Trans = " << mol.getNumTransitions() << std::endl;
 				}
 			} else {
+				GraphMemoryReservation reservation(memory_budget,
+				                                   GraphMemoryBudget::estimateGraphBytes(mol.getSmilesOrInchi()));
 				time_t before, after;
 				before = time(nullptr);
 				mol.computeFragmentGraphAndReplaceMolsWithFVs(&fc, true);
@@ -216,6 +227,7 @@ int main(int argc, char *argv[]) {
 	}
 
 	after_fg = time(nullptr);
+	delete memory_budget;
 	std::cout << "Done" << std::endl;
 
 	std::cout << success_count << " successfully computed. " << except_count << " exceptions." << std::endl;